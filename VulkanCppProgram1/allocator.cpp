@@ -0,0 +1,290 @@
+#include "allocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+static const VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+static const VkDeviceSize HOST_BLOCK_SIZE = 16ull * 1024 * 1024;
+
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+
+void DeviceAllocator::init(VkPhysicalDevice phys_device, VkDevice logical_device)
+{
+	m_logical_device = logical_device;
+	vkGetPhysicalDeviceMemoryProperties(phys_device, &m_mem_props);
+
+	VkPhysicalDeviceProperties dev_props;
+	vkGetPhysicalDeviceProperties(phys_device, &dev_props);
+	m_non_coherent_atom = std::max<VkDeviceSize>(dev_props.limits.nonCoherentAtomSize, 1);
+
+	// One pool for linear and one for optimal resources per memory type.
+	m_pools.resize(m_mem_props.memoryTypeCount * 2);
+	for (uint32_t i = 0; i < m_pools.size(); ++i)
+		m_pools[i].memory_type = i / 2;
+}
+
+void DeviceAllocator::destroy()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto& pool : m_pools) {
+		for (auto& block : pool.blocks) {
+			if (block.memory == VK_NULL_HANDLE)
+				continue;
+			if (block.mapped)
+				vkUnmapMemory(m_logical_device, block.memory);
+			vkFreeMemory(m_logical_device, block.memory, nullptr);
+		}
+		pool.blocks.clear();
+	}
+}
+
+Allocation DeviceAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	uint32_t memory_type = findMemoryType(requirements.memoryTypeBits, properties);
+	uint32_t pool_idx = memory_type * 2 + (linear ? 0 : 1);
+	Pool& pool = m_pools[pool_idx];
+
+	VkMemoryPropertyFlags type_flags = m_mem_props.memoryTypes[memory_type].propertyFlags;
+	VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+	if ((type_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(type_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+		alignment = std::max(alignment, m_non_coherent_atom);
+
+	Allocation allocation = {};
+	allocation.size = requirements.size;
+	allocation.pool = pool_idx;
+
+	VkDeviceSize block_size = preferredBlockSize(memory_type);
+
+	// Large resources get a block of their own instead of fragmenting a shared one.
+	if (requirements.size > block_size / 2) {
+		allocation.block = createBlock(pool, requirements.size);
+		allocateFromBlock(pool.blocks[allocation.block], requirements.size, alignment, allocation.offset);
+	}
+	else {
+		bool found = false;
+		for (uint32_t i = 0; i < pool.blocks.size() && !found; ++i) {
+			if (pool.blocks[i].memory != VK_NULL_HANDLE && allocateFromBlock(pool.blocks[i], requirements.size, alignment, allocation.offset)) {
+				allocation.block = i;
+				found = true;
+			}
+		}
+
+		if (!found) {
+			allocation.block = createBlock(pool, block_size);
+			if (!allocateFromBlock(pool.blocks[allocation.block], requirements.size, alignment, allocation.offset))
+				throw std::runtime_error("Failed to sub-allocate device memory.");
+		}
+	}
+
+	const Block& block = pool.blocks[allocation.block];
+	allocation.memory = block.memory;
+	if (block.mapped)
+		allocation.mapped = static_cast<char*>(block.mapped) + allocation.offset;
+
+	return allocation;
+}
+
+void DeviceAllocator::free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Pool& pool = m_pools[allocation.pool];
+	Block& block = pool.blocks[allocation.block];
+
+	// Return the range and merge it with its free neighbours.
+	VkDeviceSize offset = allocation.offset;
+	VkDeviceSize size = allocation.size;
+
+	auto next = block.free_ranges.lower_bound(offset);
+	if (next != block.free_ranges.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			block.free_ranges.erase(prev);
+		}
+	}
+	if (next != block.free_ranges.end() && offset + size == next->first) {
+		size += next->second;
+		block.free_ranges.erase(next);
+	}
+	block.free_ranges[offset] = size;
+	block.used -= allocation.size;
+
+	// Give empty blocks back to the driver, but keep one around per pool so
+	// a free/allocate pattern does not thrash vkAllocateMemory.
+	if (block.used == 0) {
+		uint32_t live_blocks = 0;
+		for (const auto& b : pool.blocks)
+			if (b.memory != VK_NULL_HANDLE)
+				live_blocks++;
+
+		if (live_blocks > 1 || block.size > preferredBlockSize(pool.memory_type)) {
+			if (block.mapped)
+				vkUnmapMemory(m_logical_device, block.memory);
+			vkFreeMemory(m_logical_device, block.memory, nullptr);
+			block = Block();
+		}
+	}
+
+	allocation = Allocation();
+}
+
+uint32_t DeviceAllocator::findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < m_mem_props.memoryTypeCount; ++i)
+		if ((type_filter & (1 << i)) && (m_mem_props.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+
+	throw std::runtime_error("Failed to find suitable memory type.");
+}
+
+VkDeviceSize DeviceAllocator::preferredBlockSize(uint32_t memory_type) const
+{
+	const VkMemoryType& type = m_mem_props.memoryTypes[memory_type];
+	VkDeviceSize heap_size = m_mem_props.memoryHeaps[type.heapIndex].size;
+
+	VkDeviceSize block_size = (type.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? DEFAULT_BLOCK_SIZE : HOST_BLOCK_SIZE;
+
+	// Small heaps (e.g. the 256MiB BAR window) should not be eaten by a single block.
+	return std::min(block_size, heap_size / 8);
+}
+
+bool DeviceAllocator::allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	auto best = block.free_ranges.end();
+	VkDeviceSize best_waste = 0;
+
+	for (auto it = block.free_ranges.begin(); it != block.free_ranges.end(); ++it) {
+		VkDeviceSize aligned = alignUp(it->first, alignment);
+		if (aligned + size > it->first + it->second)
+			continue;
+
+		VkDeviceSize waste = it->second - size;
+		if (best == block.free_ranges.end() || waste < best_waste) {
+			best = it;
+			best_waste = waste;
+		}
+	}
+
+	if (best == block.free_ranges.end())
+		return false;
+
+	VkDeviceSize range_offset = best->first;
+	VkDeviceSize range_end = best->first + best->second;
+	offset = alignUp(range_offset, alignment);
+
+	// Split the range, keeping the alignment padding and the tail free.
+	block.free_ranges.erase(best);
+	if (offset > range_offset)
+		block.free_ranges[range_offset] = offset - range_offset;
+	if (offset + size < range_end)
+		block.free_ranges[offset + size] = range_end - (offset + size);
+
+	block.used += size;
+	return true;
+}
+
+uint32_t DeviceAllocator::createBlock(Pool& pool, VkDeviceSize size)
+{
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = size;
+	alloc_info.memoryTypeIndex = pool.memory_type;
+
+	Block block;
+	block.size = size;
+	block.free_ranges[0] = size;
+
+	if (vkAllocateMemory(m_logical_device, &alloc_info, nullptr, &block.memory) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate device memory block.");
+
+	if (m_mem_props.memoryTypes[pool.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(m_logical_device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped) != VK_SUCCESS)
+			throw std::runtime_error("Failed to map device memory block.");
+	}
+
+	// Reuse a slot released by free() so outstanding block indices stay valid.
+	for (uint32_t i = 0; i < pool.blocks.size(); ++i) {
+		if (pool.blocks[i].memory == VK_NULL_HANDLE) {
+			pool.blocks[i] = std::move(block);
+			return i;
+		}
+	}
+
+	pool.blocks.push_back(std::move(block));
+	return static_cast<uint32_t>(pool.blocks.size() - 1);
+}
+
+
+void createBuffer(DeviceAllocator& allocator, VkDevice logical_device, VkDeviceSize size,
+	VkBufferUsageFlags usage_flags, VkMemoryPropertyFlags prop_flags, VkBuffer & buffer,
+	Allocation & buffer_alloc)
+{
+	VkBufferCreateInfo buffer_info = {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = size;
+	buffer_info.usage = usage_flags;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(logical_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create buffer.");
+
+	VkMemoryRequirements mem_requirements;
+	vkGetBufferMemoryRequirements(logical_device, buffer, &mem_requirements);
+
+	buffer_alloc = allocator.allocate(mem_requirements, prop_flags, true);
+
+	vkBindBufferMemory(logical_device, buffer, buffer_alloc.memory, buffer_alloc.offset);
+}
+
+
+void createImage(DeviceAllocator& allocator, VkDevice logical_device, std::array<uint32_t, 3>& img_dims, VkFormat format,
+	 VkImageTiling tiling, VkImageUsageFlags usage,	VkMemoryPropertyFlags properties, VkImage& image, Allocation& image_alloc,
+	uint32_t mip_levels)
+{
+	VkImageCreateInfo img_info = {};
+	img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	img_info.extent.width = img_dims[0];
+	img_info.extent.height = img_dims[1];
+	img_info.extent.depth = img_dims[2];
+	img_info.mipLevels = mip_levels;
+	img_info.arrayLayers = 1;
+	img_info.format = format;
+	img_info.tiling = tiling;
+	img_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	img_info.usage = usage;
+	img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	img_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	img_info.flags = 0;
+
+	if (img_dims[1] == 1 && img_dims[2] == 1)
+		img_info.imageType = VK_IMAGE_TYPE_1D;
+	else if (img_dims[2] == 1)
+		img_info.imageType = VK_IMAGE_TYPE_2D;
+	else
+		img_info.imageType = VK_IMAGE_TYPE_3D;
+
+	if (vkCreateImage(logical_device, &img_info, nullptr, &image) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create image.");
+
+	VkMemoryRequirements mem_requirements;
+	vkGetImageMemoryRequirements(logical_device, image, &mem_requirements);
+
+	// Linear-tiled images share the buffer pools' granularity class.
+	image_alloc = allocator.allocate(mem_requirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
+
+	vkBindImageMemory(logical_device, image, image_alloc.memory, image_alloc.offset);
+}
@@ -0,0 +1,75 @@
+#ifndef __DEVICE_ALLOCATOR__
+#define __DEVICE_ALLOCATOR__
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <map>
+#include <mutex>
+
+
+// A sub-range of a VkDeviceMemory block handed out by DeviceAllocator.
+struct Allocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+    uint32_t pool = 0;
+    uint32_t block = 0;
+};
+
+
+// Block based sub-allocator. Memory is requested from the driver in large
+// blocks per memory type and carved up with a best-fit free list, so the
+// number of live vkAllocateMemory calls stays far below
+// maxMemoryAllocationCount. Linear (buffers) and optimal (images) resources
+// live in separate pools so bufferImageGranularity never has to be checked
+// between neighbours. Host-visible blocks are persistently mapped.
+class DeviceAllocator
+{
+public:
+    void init(VkPhysicalDevice phys_device, VkDevice logical_device);
+    void destroy();
+
+    Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear);
+    void free(Allocation& allocation);
+
+private:
+    struct Block
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        VkDeviceSize used = 0;
+        void* mapped = nullptr;
+        std::map<VkDeviceSize, VkDeviceSize> free_ranges;
+    };
+
+    struct Pool
+    {
+        uint32_t memory_type = 0;
+        std::vector<Block> blocks;
+    };
+
+    uint32_t findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+    VkDeviceSize preferredBlockSize(uint32_t memory_type) const;
+    bool allocateFromBlock(Block& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+    uint32_t createBlock(Pool& pool, VkDeviceSize size);
+
+    VkDevice m_logical_device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties m_mem_props = {};
+    VkDeviceSize m_non_coherent_atom = 1;
+    std::vector<Pool> m_pools;
+    std::mutex m_mutex;
+};
+
+
+void createBuffer(DeviceAllocator& allocator, VkDevice logical_device, VkDeviceSize size,
+    VkBufferUsageFlags usage_flags, VkMemoryPropertyFlags prop_flags, VkBuffer& buffer,
+    Allocation& buffer_alloc);
+void createImage(DeviceAllocator& allocator, VkDevice logical_device, std::array<uint32_t, 3>& img_dims, VkFormat format,
+    VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& image_alloc,
+    uint32_t mip_levels = 1);
+
+
+#endif // __DEVICE_ALLOCATOR__
@@ -0,0 +1,144 @@
+#include "assetpack.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+bool AssetPack::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	GetFileSizeEx(file, &file_size);
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	void* base = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	m_file = file;
+	m_mapping = mapping;
+
+	if (!base) {
+		close();
+		throw std::runtime_error("Failed to map asset pack.");
+	}
+
+	m_base = static_cast<const char*>(base);
+	m_size = static_cast<size_t>(file_size.QuadPart);
+#else
+	m_fd = ::open(path.c_str(), O_RDONLY);
+	if (m_fd < 0)
+		return false;
+
+	struct stat st;
+	void* base = MAP_FAILED;
+	if (fstat(m_fd, &st) == 0 && st.st_size > 0)
+		base = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, m_fd, 0);
+
+	if (base == MAP_FAILED) {
+		close();
+		throw std::runtime_error("Failed to map asset pack.");
+	}
+
+	m_base = static_cast<const char*>(base);
+	m_size = static_cast<size_t>(st.st_size);
+#endif
+
+	PackHeader header;
+	if (m_size < sizeof(header)) {
+		close();
+		throw std::runtime_error("Invalid asset pack.");
+	}
+
+	memcpy(&header, m_base, sizeof(header));
+	if (memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 || header.version != PACK_VERSION ||
+		header.entry_count > (m_size - sizeof(header)) / sizeof(PackEntry)) {
+		close();
+		throw std::runtime_error("Invalid asset pack.");
+	}
+
+	const PackEntry* entries = reinterpret_cast<const PackEntry*>(m_base + sizeof(header));
+	for (uint32_t i = 0; i < header.entry_count; i++) {
+		const PackEntry& entry = entries[i];
+		if (entry.offset > m_size || entry.size > m_size - entry.offset) {
+			close();
+			throw std::runtime_error("Asset pack entry out of range.");
+		}
+
+		m_entries[std::string(entry.name, strnlen(entry.name, sizeof(entry.name)))] = &entry;
+	}
+
+	return true;
+}
+
+void AssetPack::close()
+{
+#ifdef _WIN32
+	if (m_base)
+		UnmapViewOfFile(m_base);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_base)
+		munmap(const_cast<char*>(m_base), m_size);
+	if (m_fd >= 0)
+		::close(m_fd);
+	m_fd = -1;
+#endif
+
+	m_base = nullptr;
+	m_size = 0;
+	m_entries.clear();
+}
+
+bool AssetPack::find(const std::string& name, const char*& data, size_t& size) const
+{
+	auto it = m_entries.find(name);
+	if (it == m_entries.end())
+		return false;
+
+	data = m_base + it->second->offset;
+	size = static_cast<size_t>(it->second->size);
+	return true;
+}
+
+bool AssetPack::load(const std::string& name, AssetData& asset) const
+{
+	asset.storage.clear();
+	if (find(name, asset.data, asset.size))
+		return true;
+
+	std::ifstream fp(name, std::ios::ate | std::ios::binary);
+
+	if (!fp.is_open())
+		return false;
+
+	asset.size = (size_t)fp.tellg();
+	asset.storage.resize(asset.size);
+
+	fp.seekg(0);
+	fp.read(asset.storage.data(), asset.size);
+	fp.close();
+
+	asset.data = asset.storage.data();
+	return true;
+}
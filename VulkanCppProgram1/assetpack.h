@@ -0,0 +1,71 @@
+#ifndef __ASSET_PACK__
+#define __ASSET_PACK__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+
+// On-disk layout: a PackHeader, entry_count PackEntry records and then the
+// payloads, each starting at a multiple of the header's alignment so SPIR-V
+// and texture data can be used directly from the mapping.
+struct PackHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t alignment;
+};
+
+struct PackEntry
+{
+    char name[48];
+    uint64_t offset;
+    uint64_t size;
+};
+
+const char PACK_MAGIC[4] = { 'V', 'K', 'A', 'P' };
+const uint32_t PACK_VERSION = 1;
+const uint32_t PACK_ALIGNMENT = 256;
+
+
+// Bytes of one asset. Points into the pack mapping when the asset was
+// found there, otherwise into storage holding the loose file.
+struct AssetData
+{
+    const char* data = nullptr;
+    size_t size = 0;
+    std::vector<char> storage;
+};
+
+
+// Read-only memory mapping of a pack file. Lookups return pointers into the
+// mapping that stay valid until close().
+class AssetPack
+{
+public:
+    ~AssetPack() { close(); }
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return m_base != nullptr; }
+
+    bool find(const std::string& name, const char*& data, size_t& size) const;
+    // Falls back to reading the loose file at name. Returns false if neither exists.
+    bool load(const std::string& name, AssetData& asset) const;
+
+private:
+    const char* m_base = nullptr;
+    size_t m_size = 0;
+    std::map<std::string, const PackEntry*> m_entries;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
+
+
+#endif // __ASSET_PACK__
@@ -0,0 +1,119 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+
+static const char* const PHASE_NAMES[Benchmark::PHASE_COUNT] = {
+	"acquire", "update", "submit", "present", "frame", "gpu"
+};
+
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+	return sorted[std::max(rank, size_t(1)) - 1];
+}
+
+
+static std::string jsonString(const std::string& value)
+{
+	std::string quoted = "\"";
+	for (char c : value) {
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		if (static_cast<unsigned char>(c) >= 0x20)
+			quoted += c;
+	}
+	return quoted + "\"";
+}
+
+
+static void writeStats(std::ofstream& out, const std::vector<double>& samples)
+{
+	if (samples.empty()) {
+		out << "null";
+		return;
+	}
+
+	std::vector<double> sorted = samples;
+	std::sort(sorted.begin(), sorted.end());
+
+	out << "{ \"samples\": " << sorted.size()
+		<< ", \"p50\": " << percentile(sorted, 50.0)
+		<< ", \"p95\": " << percentile(sorted, 95.0)
+		<< ", \"p99\": " << percentile(sorted, 99.0)
+		<< ", \"max\": " << sorted.back() << " }";
+}
+
+
+void Benchmark::init(uint32_t warmup_frames, uint32_t frames)
+{
+	m_warmup_frames = warmup_frames;
+	m_frames = frames;
+	m_start_ms = m_elapsed_ms = 0.0;
+
+	for (auto& samples : m_samples) {
+		samples.clear();
+		samples.reserve(frames);
+	}
+}
+
+void Benchmark::beginFrame(uint64_t frame_number, double now_ms)
+{
+	if (active() && frame_number == m_warmup_frames + 1)
+		m_start_ms = now_ms;
+}
+
+void Benchmark::record(uint64_t frame_number, Phase phase, double ms)
+{
+	if (measured(frame_number))
+		m_samples[phase].push_back(ms);
+}
+
+void Benchmark::finish(double now_ms)
+{
+	if (m_start_ms > 0.0)
+		m_elapsed_ms = now_ms - m_start_ms;
+}
+
+void Benchmark::writeJson(const char* path, const Context& context) const
+{
+	std::ofstream out(path, std::ios::trunc);
+	if (!out)
+		throw std::runtime_error(std::string("Failed to open benchmark output ") + path);
+
+	// A run cut short by closing the window reports the frames it got to.
+	const size_t frames = m_samples[Frame].size();
+	const double fps = m_elapsed_ms > 0.0 ? frames * 1000.0 / m_elapsed_ms : 0.0;
+
+	out << "{\n"
+		<< "  \"frames\": " << frames << ",\n"
+		<< "  \"warmup_frames\": " << m_warmup_frames << ",\n"
+		<< "  \"elapsed_ms\": " << m_elapsed_ms << ",\n"
+		<< "  \"fps\": " << fps << ",\n"
+		<< "  \"device\": " << jsonString(context.device) << ",\n"
+		<< "  \"present_mode\": " << jsonString(context.present_mode) << ",\n"
+		<< "  \"frames_in_flight\": " << context.frames_in_flight << ",\n"
+		<< "  \"depth_changes\": " << context.depth_changes << ",\n"
+		<< "  \"object_count\": " << context.object_count << ",\n"
+		<< "  \"headless\": " << (context.headless ? "true" : "false") << ",\n"
+		<< "  \"cpu_ms\": {\n";
+
+	for (int phase = 0; phase < Gpu; phase++) {
+		out << "    \"" << PHASE_NAMES[phase] << "\": ";
+		writeStats(out, m_samples[phase]);
+		out << (phase + 1 < Gpu ? ",\n" : "\n");
+	}
+
+	out << "  },\n"
+		<< "  \"gpu_ms\": ";
+	writeStats(out, m_samples[Gpu]);
+	out << "\n}\n";
+
+	if (!out)
+		throw std::runtime_error(std::string("Failed to write benchmark output ") + path);
+}
@@ -0,0 +1,69 @@
+#ifndef __BENCHMARK__
+#define __BENCHMARK__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Collects per-frame timings of a fixed-length run and writes their
+// distribution as JSON. Frames up to the warm-up count are rendered but not
+// recorded, they cover pipeline compilation, the initial upload and the
+// driver settling on its clocks.
+class Benchmark
+{
+public:
+    enum Phase
+    {
+        // vkAcquireNextImageKHR, including the wait for a free image.
+        Acquire,
+        // Uniform jobs and command recording, which overlap.
+        Update,
+        // vkQueueSubmit.
+        Submit,
+        // vkQueuePresentKHR, never sampled when headless.
+        Present,
+        // The whole of drawFrame, pacing waits included.
+        Frame,
+        // GPU time between the first and last command of the frame.
+        Gpu,
+        PHASE_COUNT
+    };
+
+    // Written next to the numbers so runs can be told apart.
+    struct Context
+    {
+        std::string device;
+        std::string present_mode;
+        uint32_t frames_in_flight = 0;
+        // Times the adaptive pacer changed the depth during the run.
+        uint32_t depth_changes = 0;
+        uint32_t object_count = 0;
+        bool headless = false;
+    };
+
+    void init(uint32_t warmup_frames, uint32_t frames);
+
+    bool active() const { return m_frames > 0; }
+    bool measured(uint64_t frame_number) const { return active() && frame_number > m_warmup_frames; }
+
+    // Starts the clock when the first measured frame begins.
+    void beginFrame(uint64_t frame_number, double now_ms);
+    // GPU samples arrive frames late, they are filed under the frame that
+    // produced them.
+    void record(uint64_t frame_number, Phase phase, double ms);
+    // Stops the clock, call once every measured frame has completed.
+    void finish(double now_ms);
+
+    void writeJson(const char* path, const Context& context) const;
+
+private:
+    uint32_t m_warmup_frames = 0;
+    uint32_t m_frames = 0;
+    double m_start_ms = 0.0;
+    double m_elapsed_ms = 0.0;
+    std::vector<double> m_samples[PHASE_COUNT];
+};
+
+
+#endif // __BENCHMARK__
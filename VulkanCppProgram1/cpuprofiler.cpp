@@ -0,0 +1,132 @@
+#include "cpuprofiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// Events kept per thread, about 1.5 MB each.
+static const size_t EVENTS_PER_THREAD = 64 * 1024;
+
+
+struct ProfileEvent
+{
+	const char* name;
+	int64_t begin_ns;
+	int64_t end_ns;
+};
+
+
+struct ThreadEvents
+{
+	uint32_t tid = 0;
+	std::string name;
+	// Allocated by the thread's first recorded zone.
+	std::vector<ProfileEvent> events;
+	// Only the owning thread writes, the release store publishes the event
+	// it just filled in.
+	std::atomic<uint64_t> written{ 0 };
+};
+
+
+static const std::chrono::steady_clock::time_point s_epoch = std::chrono::steady_clock::now();
+static std::atomic<bool> s_enabled{ false };
+
+// Owned here rather than by the threads, so the events of finished worker
+// threads still make it into the trace.
+static std::mutex s_threads_mutex;
+static std::vector<std::unique_ptr<ThreadEvents>> s_threads;
+static thread_local ThreadEvents* s_thread_events = nullptr;
+
+
+static ThreadEvents& threadEvents()
+{
+	if (!s_thread_events) {
+		auto events = std::make_unique<ThreadEvents>();
+
+		std::lock_guard<std::mutex> lock(s_threads_mutex);
+		events->tid = static_cast<uint32_t>(s_threads.size() + 1);
+		events->name = "thread " + std::to_string(events->tid);
+		s_thread_events = events.get();
+		s_threads.push_back(std::move(events));
+	}
+
+	return *s_thread_events;
+}
+
+
+void CpuProfiler::setEnabled(bool enabled)
+{
+	s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool CpuProfiler::enabled()
+{
+	return s_enabled.load(std::memory_order_relaxed);
+}
+
+void CpuProfiler::setThreadName(const char* name)
+{
+	ThreadEvents& events = threadEvents();
+
+	std::lock_guard<std::mutex> lock(s_threads_mutex);
+	events.name = name;
+}
+
+int64_t CpuProfiler::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_epoch).count();
+}
+
+void CpuProfiler::record(const char* name, int64_t begin_ns, int64_t end_ns)
+{
+	ThreadEvents& events = threadEvents();
+
+	// Only zones recorded while enabled get here, so naming a thread in a
+	// run without --trace never allocates its ring.
+	if (events.events.empty())
+		events.events.resize(EVENTS_PER_THREAD);
+
+	const uint64_t index = events.written.load(std::memory_order_relaxed);
+	events.events[index % EVENTS_PER_THREAD] = { name, begin_ns, end_ns };
+	events.written.store(index + 1, std::memory_order_release);
+}
+
+void CpuProfiler::writeChromeTrace(const char* path)
+{
+	std::ofstream out(path, std::ios::trunc);
+	if (!out)
+		throw std::runtime_error(std::string("Failed to open trace output ") + path);
+
+	std::lock_guard<std::mutex> lock(s_threads_mutex);
+
+	// Complete ("X") events in microseconds, plus a name for every track.
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (const auto& thread : s_threads) {
+		out << (first ? "" : ",\n")
+			<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->tid
+			<< ",\"args\":{\"name\":\"" << thread->name << "\"}}";
+		first = false;
+
+		const uint64_t written = thread->written.load(std::memory_order_acquire);
+		const uint64_t oldest = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+
+		for (uint64_t i = oldest; i < written; i++) {
+			const ProfileEvent& event = thread->events[i % EVENTS_PER_THREAD];
+			out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->tid
+				<< ",\"ts\":" << event.begin_ns / 1000.0 << ",\"dur\":" << (event.end_ns - event.begin_ns) / 1000.0 << "}";
+		}
+	}
+	out << "\n]}\n";
+
+	if (!out)
+		throw std::runtime_error(std::string("Failed to write trace output ") + path);
+}
@@ -0,0 +1,68 @@
+#ifndef __CPU_PROFILER__
+#define __CPU_PROFILER__
+
+#include <cstdint>
+
+
+// Records scoped timing zones from any thread and writes them as a Chrome
+// trace, viewable in chrome://tracing or Perfetto. Every thread appends to
+// its own fixed-size ring of events, so recording takes no lock; only a
+// thread's first event registers its ring. When a ring wraps the oldest
+// events are dropped, a trace always covers the most recent activity.
+//
+// Zones only exist in builds with ENABLE_CPU_PROFILER defined, otherwise
+// the macros expand to nothing. Zone names must outlive the trace, string
+// literals and __func__ do.
+class CpuProfiler
+{
+public:
+    class Zone
+    {
+    public:
+        explicit Zone(const char* name)
+            : m_name(name), m_begin_ns(enabled() ? now() : -1)
+        {
+        }
+
+        ~Zone()
+        {
+            if (m_begin_ns >= 0)
+                record(m_name, m_begin_ns, now());
+        }
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+    private:
+        const char* m_name;
+        int64_t m_begin_ns;
+    };
+
+    static void setEnabled(bool enabled);
+    static bool enabled();
+    // Shown as the thread's track name in the trace.
+    static void setThreadName(const char* name);
+
+    // Nanoseconds since the process started.
+    static int64_t now();
+    static void record(const char* name, int64_t begin_ns, int64_t end_ns);
+
+    // Only call once the recording threads are idle or gone.
+    static void writeChromeTrace(const char* path);
+};
+
+
+#ifdef ENABLE_CPU_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) CpuProfiler::Zone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD(name) CpuProfiler::setThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif // ENABLE_CPU_PROFILER
+
+
+#endif // __CPU_PROFILER__
@@ -0,0 +1,29 @@
+#include "deletionqueue.h"
+
+#include <limits>
+
+
+void DeletionQueue::push(uint64_t frame_number, std::function<void()> deleter)
+{
+	m_entries.push_back({ frame_number, std::move(deleter) });
+}
+
+void DeletionQueue::collect(uint64_t completed_frame)
+{
+	// Deleters may release further objects, so run them from a detached list.
+	std::vector<std::function<void()>> deleters;
+	while (!m_entries.empty() && m_entries.front().frame_number <= completed_frame) {
+		deleters.push_back(std::move(m_entries.front().deleter));
+		m_entries.pop_front();
+	}
+
+	// Destroy in reverse release order, dependents go before what they use.
+	for (auto it = deleters.rbegin(); it != deleters.rend(); ++it)
+		(*it)();
+}
+
+void DeletionQueue::flush()
+{
+	while (!m_entries.empty())
+		collect(std::numeric_limits<uint64_t>::max());
+}
@@ -0,0 +1,35 @@
+#ifndef __DELETION_QUEUE__
+#define __DELETION_QUEUE__
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+
+// Defers destruction of GPU objects released while rendering. Deleters are
+// tagged with the number of the last frame submitted when the object was
+// released and run once the frame timeline has reached that number, at
+// which point no submitted frame can still reference the object.
+class DeletionQueue
+{
+public:
+    void push(uint64_t frame_number, std::function<void()> deleter);
+    // Runs every deleter whose frame has completed, without blocking.
+    void collect(uint64_t completed_frame);
+    // Runs every pending deleter, only safe once the device is idle.
+    void flush();
+
+private:
+    struct Entry
+    {
+        uint64_t frame_number;
+        std::function<void()> deleter;
+    };
+
+    // Frame numbers never decrease, so completed entries sit at the front.
+    std::deque<Entry> m_entries;
+};
+
+
+#endif // __DELETION_QUEUE__
@@ -0,0 +1,74 @@
+#include "framepacer.h"
+
+#include <algorithm>
+
+
+// Frames per decision, long enough to ride out single outliers.
+static const uint32_t PACER_WINDOW = 120;
+// Going down a frame is only worth it when the slowest CPU frame still fits
+// in this fraction of the period. At depth 1 the GPU idles while the CPU
+// works, so this also bounds the throughput lost there.
+static const double SHRINK_CPU_RATIO = 0.5;
+// The CPU must have waited at least this fraction of the period, otherwise
+// it is the CPU that sets the pace and a shallower queue gains nothing.
+static const double SHRINK_WAIT_RATIO = 0.25;
+// A CPU frame this much longer than the period counts as a spike.
+static const double GROW_CPU_RATIO = 1.25;
+
+
+void FramePacer::init(uint32_t frames_in_flight, uint32_t max_frames_in_flight, bool adaptive)
+{
+	m_max_frames = std::max(max_frames_in_flight, 1u);
+	m_adaptive = adaptive;
+	m_metrics = Metrics();
+	m_metrics.frames_in_flight = std::min(std::max(frames_in_flight, 1u), m_max_frames);
+	m_pinned = 0;
+	m_window_frames = 0;
+	m_cpu_sum = m_cpu_max = m_wait_sum = m_frame_sum = 0.0;
+}
+
+void FramePacer::pin(uint32_t frames_in_flight)
+{
+	m_pinned = std::min(frames_in_flight, m_max_frames);
+
+	// Windows measured at another depth say nothing about the new one.
+	m_window_frames = 0;
+	m_cpu_sum = m_cpu_max = m_wait_sum = m_frame_sum = 0.0;
+}
+
+bool FramePacer::endFrame(double cpu_ms, double wait_ms, double frame_ms)
+{
+	m_cpu_sum += cpu_ms;
+	m_cpu_max = std::max(m_cpu_max, cpu_ms);
+	m_wait_sum += wait_ms;
+	m_frame_sum += frame_ms;
+
+	if (++m_window_frames < PACER_WINDOW)
+		return false;
+
+	m_metrics.cpu_ms = m_cpu_sum / m_window_frames;
+	m_metrics.cpu_max_ms = m_cpu_max;
+	m_metrics.wait_ms = m_wait_sum / m_window_frames;
+	m_metrics.frame_ms = m_frame_sum / m_window_frames;
+
+	m_window_frames = 0;
+	m_cpu_sum = m_cpu_max = m_wait_sum = m_frame_sum = 0.0;
+
+	if (!m_adaptive || m_pinned > 0)
+		return false;
+
+	uint32_t depth = m_metrics.frames_in_flight;
+	const double period = m_metrics.frame_ms;
+
+	if (m_metrics.cpu_max_ms > period * GROW_CPU_RATIO && depth < m_max_frames)
+		depth++;
+	else if (m_metrics.cpu_max_ms < period * SHRINK_CPU_RATIO && m_metrics.wait_ms > period * SHRINK_WAIT_RATIO && depth > 1)
+		depth--;
+
+	if (depth == m_metrics.frames_in_flight)
+		return false;
+
+	m_metrics.frames_in_flight = depth;
+	m_metrics.depth_changes++;
+	return true;
+}
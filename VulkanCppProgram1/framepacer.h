@@ -0,0 +1,56 @@
+#ifndef __FRAME_PACER__
+#define __FRAME_PACER__
+
+#include <cstdint>
+
+
+// Picks how many frames the CPU may queue ahead of the GPU. Every frame
+// reports how long the CPU worked on it and how long it blocked waiting for
+// an older frame; once per window the pacer compares the CPU time against
+// the frame period, which is the GPU time whenever the CPU had to wait.
+//
+// If even the slowest CPU frame is well below the period the GPU is the
+// bottleneck and each extra queued frame only adds a period of latency, so
+// the depth shrinks. If a CPU frame overruns the period the queue has to
+// absorb that spike or the GPU starves, so the depth grows.
+class FramePacer
+{
+public:
+    struct Metrics
+    {
+        uint32_t frames_in_flight = 0;
+        // Averages over the last complete window, in milliseconds.
+        double cpu_ms = 0.0;
+        double cpu_max_ms = 0.0;
+        double wait_ms = 0.0;
+        double frame_ms = 0.0;
+        uint32_t depth_changes = 0;
+    };
+
+    void init(uint32_t frames_in_flight, uint32_t max_frames_in_flight, bool adaptive);
+
+    // Holds the depth at frames_in_flight and stops adapting, 0 releases it
+    // and the depth picked before applies again.
+    void pin(uint32_t frames_in_flight);
+
+    // Returns true when the window ended with a new depth.
+    bool endFrame(double cpu_ms, double wait_ms, double frame_ms);
+
+    uint32_t framesInFlight() const { return m_pinned > 0 ? m_pinned : m_metrics.frames_in_flight; }
+    const Metrics& metrics() const { return m_metrics; }
+
+private:
+    Metrics m_metrics;
+    uint32_t m_max_frames = 1;
+    bool m_adaptive = false;
+    uint32_t m_pinned = 0;
+
+    uint32_t m_window_frames = 0;
+    double m_cpu_sum = 0.0;
+    double m_cpu_max = 0.0;
+    double m_wait_sum = 0.0;
+    double m_frame_sum = 0.0;
+};
+
+
+#endif // __FRAME_PACER__
@@ -0,0 +1,160 @@
+#include "gpuprofiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+double GpuProfiler::Region::averageMs() const
+{
+	if (history.empty())
+		return 0.0;
+
+	double sum = 0.0;
+	for (double ms : history)
+		sum += ms;
+	return sum / history.size();
+}
+
+double GpuProfiler::Region::maxMs() const
+{
+	if (history.empty())
+		return 0.0;
+	return *std::max_element(history.begin(), history.end());
+}
+
+
+void GpuProfiler::init(VkPhysicalDevice phys_device, VkDevice logical_device, bool host_query_reset, uint32_t max_scopes)
+{
+	m_logical_device = logical_device;
+
+	uint32_t count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(phys_device, &count, nullptr);
+	std::vector<VkQueueFamilyProperties> families(count);
+	vkGetPhysicalDeviceQueueFamilyProperties(phys_device, &count, families.data());
+
+	bool any_timestamps = false;
+	m_family_masks.assign(count, 0);
+	for (uint32_t i = 0; i < count; i++) {
+		const uint32_t bits = families[i].timestampValidBits;
+		m_family_masks[i] = bits >= 64 ? ~0ull : (1ull << bits) - 1;
+		any_timestamps |= bits > 0;
+	}
+
+	if (!host_query_reset || !any_timestamps)
+		return;
+
+	VkPhysicalDeviceProperties dev_props;
+	vkGetPhysicalDeviceProperties(phys_device, &dev_props);
+	m_period = dev_props.limits.timestampPeriod;
+
+	VkQueryPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	pool_info.queryCount = 2 * max_scopes;
+
+	if (vkCreateQueryPool(m_logical_device, &pool_info, nullptr, &m_pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create timestamp query pool.");
+
+	// Queries start out undefined, every pair is reset before its first use.
+	vkResetQueryPool(m_logical_device, m_pool, 0, pool_info.queryCount);
+
+	m_scopes.assign(max_scopes, PendingScope());
+	m_free_scopes.clear();
+	for (Scope scope = max_scopes; scope > 0; scope--)
+		m_free_scopes.push_back(scope - 1);
+	m_pending.clear();
+}
+
+void GpuProfiler::destroy()
+{
+	if (m_pool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(m_logical_device, m_pool, nullptr);
+
+	m_pool = VK_NULL_HANDLE;
+	m_scopes.clear();
+	m_free_scopes.clear();
+	m_pending.clear();
+}
+
+GpuProfiler::RegionId GpuProfiler::region(const char* name)
+{
+	for (RegionId id = 0; id < m_regions.size(); id++) {
+		if (m_regions[id].name == name)
+			return id;
+	}
+
+	Region region;
+	region.name = name;
+	region.history.reserve(HISTORY_SIZE);
+	m_regions.push_back(region);
+
+	return static_cast<RegionId>(m_regions.size() - 1);
+}
+
+GpuProfiler::Scope GpuProfiler::begin(VkCommandBuffer cmd_buffer, uint32_t queue_family, RegionId region, uint64_t tag)
+{
+	if (!enabled() || m_free_scopes.empty() || m_family_masks[queue_family] == 0)
+		return NO_SCOPE;
+
+	Scope scope = m_free_scopes.back();
+	m_free_scopes.pop_back();
+
+	PendingScope& pending = m_scopes[scope];
+	pending.region = region;
+	pending.tag = tag;
+	pending.mask = m_family_masks[queue_family];
+	pending.ended = false;
+	m_pending.push_back(scope);
+
+	vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_pool, 2 * scope);
+	return scope;
+}
+
+void GpuProfiler::end(VkCommandBuffer cmd_buffer, Scope scope)
+{
+	if (scope == NO_SCOPE)
+		return;
+
+	vkCmdWriteTimestamp(cmd_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_pool, 2 * scope + 1);
+	m_scopes[scope].ended = true;
+}
+
+void GpuProfiler::collect(const SampleFn& fn)
+{
+	// Queues finish in their own order, so each pair is checked on its own
+	// and unfinished ones simply stay pending.
+	size_t kept = 0;
+	for (Scope scope : m_pending) {
+		const PendingScope& pending = m_scopes[scope];
+
+		// Timestamp and availability for both queries.
+		uint64_t data[4] = {};
+		if (pending.ended) {
+			vkGetQueryPoolResults(m_logical_device, m_pool, 2 * scope, 2, sizeof(data), data, 2 * sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		}
+
+		if (!data[1] || !data[3]) {
+			m_pending[kept++] = scope;
+			continue;
+		}
+
+		const double ms = ((data[2] - data[0]) & pending.mask) * m_period / 1e6;
+
+		Region& region = m_regions[pending.region];
+		if (region.history.size() < HISTORY_SIZE)
+			region.history.push_back(ms);
+		else
+			region.history[region.next] = ms;
+		region.next = (region.next + 1) % HISTORY_SIZE;
+		region.samples++;
+
+		if (fn)
+			fn(pending.region, pending.tag, ms);
+
+		vkResetQueryPool(m_logical_device, m_pool, 2 * scope, 2);
+		m_free_scopes.push_back(scope);
+	}
+
+	m_pending.resize(kept);
+}
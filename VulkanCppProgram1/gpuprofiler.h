@@ -0,0 +1,87 @@
+#ifndef __GPU_PROFILER__
+#define __GPU_PROFILER__
+
+#include <vulkan/vulkan.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+// Times named regions of command buffers with timestamp queries. Every
+// begin() takes a pair of queries from a shared pool and writes the first
+// one, end() writes the second. collect() polls the availability of all
+// outstanding pairs and never waits, so results arrive whenever the GPU
+// gets to them, usually a couple of frames late. Read pairs are reset from
+// the host, which also works for pairs written on a transfer-only queue.
+//
+// Not thread safe, regions are meant to be recorded into primary command
+// buffers by the thread that submits them.
+class GpuProfiler
+{
+public:
+    using RegionId = uint32_t;
+    using Scope = uint32_t;
+    static const Scope NO_SCOPE = ~0u;
+    // Rolling history kept per region.
+    static const size_t HISTORY_SIZE = 128;
+
+    struct Region
+    {
+        std::string name;
+        // Ring of the last HISTORY_SIZE results in milliseconds, oldest at
+        // next once it has wrapped.
+        std::vector<double> history;
+        size_t next = 0;
+        uint64_t samples = 0;
+
+        double averageMs() const;
+        double maxMs() const;
+    };
+
+    // Called for every result read back, tag is what begin() was given.
+    using SampleFn = std::function<void(RegionId region, uint64_t tag, double ms)>;
+
+    // Stays disabled if the device can't reset queries from the host or has
+    // no timestamps on any family, begin() then records nothing.
+    void init(VkPhysicalDevice phys_device, VkDevice logical_device, bool host_query_reset, uint32_t max_scopes);
+    void destroy();
+
+    bool enabled() const { return m_pool != VK_NULL_HANDLE; }
+
+    // Returns the region of that name, adding it on first use.
+    RegionId region(const char* name);
+    const std::vector<Region>& regions() const { return m_regions; }
+
+    // Returns NO_SCOPE, which end() ignores, when the family has no
+    // timestamps or every pair is still waiting to be read.
+    Scope begin(VkCommandBuffer cmd_buffer, uint32_t queue_family, RegionId region, uint64_t tag = 0);
+    void end(VkCommandBuffer cmd_buffer, Scope scope);
+
+    void collect(const SampleFn& fn = nullptr);
+
+private:
+    struct PendingScope
+    {
+        RegionId region = 0;
+        uint64_t tag = 0;
+        uint64_t mask = 0;
+        bool ended = false;
+    };
+
+    VkDevice m_logical_device = VK_NULL_HANDLE;
+    VkQueryPool m_pool = VK_NULL_HANDLE;
+    // Nanoseconds per tick.
+    double m_period = 0.0;
+    // Valid timestamp bits per queue family, 0 where there are none.
+    std::vector<uint64_t> m_family_masks;
+
+    std::vector<Region> m_regions;
+    // Indexed by scope, a scope owns queries 2 * scope and 2 * scope + 1.
+    std::vector<PendingScope> m_scopes;
+    std::vector<Scope> m_free_scopes;
+    std::vector<Scope> m_pending;
+};
+
+
+#endif // __GPU_PROFILER__
@@ -0,0 +1,205 @@
+#include "jobs.h"
+#include "cpuprofiler.h"
+
+#include <algorithm>
+#include <string>
+
+
+// Threads that never went through init() or workerLoop() share index 0 with
+// the init thread, so only that one should submit from outside a job.
+static thread_local uint32_t s_thread_index = 0;
+
+
+void JobSystem::init(uint32_t worker_count)
+{
+	m_stop = false;
+	s_thread_index = 0;
+
+	m_queues.clear();
+	for (uint32_t i = 0; i < worker_count + 1; i++)
+		m_queues.push_back(std::make_unique<Queue>());
+
+	for (uint32_t i = 1; i <= worker_count; i++)
+		m_threads.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+void JobSystem::destroy()
+{
+	if (m_threads.empty() && m_queues.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& thread : m_threads)
+		thread.join();
+
+	m_threads.clear();
+	m_queues.clear();
+}
+
+uint32_t JobSystem::threadIndex()
+{
+	return s_thread_index;
+}
+
+void JobSystem::run(Job job, Counter& counter)
+{
+	counter.m_pending.fetch_add(1, std::memory_order_relaxed);
+	push({ std::move(job), &counter });
+}
+
+void JobSystem::after(Counter& dependency, Job job, Counter& counter)
+{
+	counter.m_pending.fetch_add(1, std::memory_order_relaxed);
+
+	{
+		std::lock_guard<std::mutex> lock(dependency.m_mutex);
+		if (!dependency.done()) {
+			dependency.m_continuations.push_back([this, job, &counter]() mutable {
+				push({ std::move(job), &counter });
+			});
+			return;
+		}
+	}
+
+	push({ std::move(job), &counter });
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t grain, const RangeJob& job, Counter& counter)
+{
+	grain = std::max(grain, 1u);
+	auto shared = std::make_shared<RangeJob>(job);
+
+	for (uint32_t first = 0; first < count; first += grain) {
+		uint32_t items = std::min(grain, count - first);
+		run([shared, first, items]() { (*shared)(first, items); }, counter);
+	}
+}
+
+void JobSystem::wait(Counter& counter)
+{
+	while (!counter.done()) {
+		if (!runOne())
+			std::this_thread::yield();
+	}
+
+	// Taking the lock orders this return after finish() let go of the
+	// counter, so the caller is free to destroy it.
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lock(counter.m_mutex);
+		error = counter.m_error;
+		counter.m_error = nullptr;
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void JobSystem::push(Task task)
+{
+	Queue& queue = *m_queues[threadIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+
+	m_queued.fetch_add(1, std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> lock(m_sleep_mutex);
+	}
+	m_wake.notify_one();
+}
+
+bool JobSystem::pop(Task& task)
+{
+	// Newest first, its data is most likely still in this core's cache.
+	Queue& queue = *m_queues[threadIndex()];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	if (queue.tasks.empty())
+		return false;
+
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	m_queued.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool JobSystem::steal(Task& task)
+{
+	// Oldest first, those tend to be the largest pieces of remaining work.
+	const uint32_t count = threadCount();
+	for (uint32_t i = 1; i < count; i++) {
+		Queue& queue = *m_queues[(threadIndex() + i) % count];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (queue.tasks.empty())
+			continue;
+
+		task = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+		m_queued.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	return false;
+}
+
+bool JobSystem::runOne()
+{
+	Task task;
+	if (!pop(task) && !steal(task))
+		return false;
+
+	execute(task);
+	return true;
+}
+
+void JobSystem::execute(Task& task)
+{
+	try {
+		task.job();
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(task.counter->m_mutex);
+		if (!task.counter->m_error)
+			task.counter->m_error = std::current_exception();
+	}
+
+	finish(*task.counter);
+}
+
+void JobSystem::finish(Counter& counter)
+{
+	std::vector<Job> released;
+	{
+		std::lock_guard<std::mutex> lock(counter.m_mutex);
+		if (counter.m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			released.swap(counter.m_continuations);
+	}
+
+	for (auto& job : released)
+		job();
+}
+
+void JobSystem::workerLoop(uint32_t index)
+{
+	s_thread_index = index;
+	PROFILE_THREAD(("job worker " + std::to_string(index)).c_str());
+
+	for (;;) {
+		if (runOne())
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_sleep_mutex);
+		m_wake.wait(lock, [this]() { return m_stop || m_queued.load(std::memory_order_acquire) > 0; });
+
+		if (m_stop)
+			return;
+	}
+}
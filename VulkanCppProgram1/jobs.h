@@ -0,0 +1,98 @@
+#ifndef __JOB_SYSTEM__
+#define __JOB_SYSTEM__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Work-stealing job scheduler. Every thread, the one that called init()
+// included, owns a deque: it pushes and pops its own jobs at the back while
+// idle threads steal from the front of the others.
+//
+// Completion is tracked with counters. Running a job against a counter
+// increments it and finishing the job decrements it; wait() runs other jobs
+// until the counter drains, and jobs queued with after() are released as soon
+// as their dependency reaches zero.
+class JobSystem
+{
+public:
+    using Job = std::function<void()>;
+    // Runs items [first, first + count) of a parallelFor.
+    using RangeJob = std::function<void(uint32_t first, uint32_t count)>;
+
+    class Counter
+    {
+    public:
+        bool done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+
+        std::atomic<uint32_t> m_pending{ 0 };
+        std::mutex m_mutex;
+        std::vector<Job> m_continuations;
+        std::exception_ptr m_error;
+    };
+
+    // Joins the workers if destroy() wasn't called, e.g. when startup threw.
+    ~JobSystem() { destroy(); }
+
+    void init(uint32_t worker_count);
+    // Safe to call more than once.
+    void destroy();
+
+    void run(Job job, Counter& counter);
+    // Queues job once dependency drains. It counts towards counter from now.
+    void after(Counter& dependency, Job job, Counter& counter);
+    // Splits [0, count) into jobs of at most grain items.
+    void parallelFor(uint32_t count, uint32_t grain, const RangeJob& job, Counter& counter);
+    // Helps running jobs until counter drains, then rethrows the first
+    // exception raised by a job that ran against it.
+    void wait(Counter& counter);
+
+    // Threads that run jobs, the one that called init() included.
+    uint32_t threadCount() const { return static_cast<uint32_t>(m_queues.size()); }
+    // Index of the calling thread in [0, threadCount()), 0 is the thread
+    // that called init().
+    static uint32_t threadIndex();
+
+private:
+    struct Task
+    {
+        Job job;
+        Counter* counter;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push(Task task);
+    bool pop(Task& task);
+    bool steal(Task& task);
+    bool runOne();
+    void execute(Task& task);
+    void finish(Counter& counter);
+    void workerLoop(uint32_t index);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::atomic<uint32_t> m_queued{ 0 };
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+};
+
+
+#endif // __JOB_SYSTEM__
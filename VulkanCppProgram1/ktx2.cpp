@@ -0,0 +1,144 @@
+#include "ktx2.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+static const uint8_t KTX2_IDENTIFIER[12] = {
+	0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+// Fixed part of the file: identifier, header and section index.
+static const size_t KTX2_HEADER_SIZE = 80;
+static const size_t KTX2_LEVEL_ENTRY_SIZE = 24;
+
+
+// Texel block footprint of the formats the loader can upload.
+struct FormatBlock
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytes;
+};
+
+static bool formatBlock(VkFormat format, FormatBlock& block)
+{
+	switch (format) {
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		block = { 1, 1, 4 };
+		return true;
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+		block = { 4, 4, 8 };
+		return true;
+	default:
+		break;
+	}
+
+	if ((format >= VK_FORMAT_BC2_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK) ||
+		(format >= VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK && format <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK)) {
+		block = { 4, 4, 16 };
+		return true;
+	}
+
+	// ASTC comes in UNORM/SRGB pairs per footprint, in this order.
+	static const uint32_t ASTC_FOOTPRINTS[][2] = {
+		{ 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+		{ 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 }
+	};
+	if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+		const uint32_t* footprint = ASTC_FOOTPRINTS[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+		block = { footprint[0], footprint[1], 16 };
+		return true;
+	}
+
+	return false;
+}
+
+
+template<typename T>
+static T readValue(const char* data, size_t offset)
+{
+	T value;
+	memcpy(&value, data + offset, sizeof(T));
+	return value;
+}
+
+
+void parseKtx2(const char* data, size_t size, Ktx2Image& image)
+{
+	if (size < KTX2_HEADER_SIZE || memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+		throw std::runtime_error("Invalid KTX2 file.");
+
+	uint32_t vk_format = readValue<uint32_t>(data, 12);
+	uint32_t width = readValue<uint32_t>(data, 20);
+	uint32_t height = readValue<uint32_t>(data, 24);
+	uint32_t depth = readValue<uint32_t>(data, 28);
+	uint32_t layer_count = readValue<uint32_t>(data, 32);
+	uint32_t face_count = readValue<uint32_t>(data, 36);
+	uint32_t level_count = readValue<uint32_t>(data, 40);
+	uint32_t supercompression = readValue<uint32_t>(data, 44);
+
+	// VK_FORMAT_UNDEFINED marks Basis Universal payloads that need transcoding first.
+	if (vk_format == VK_FORMAT_UNDEFINED || supercompression != 0)
+		throw std::runtime_error("Unsupported KTX2 encoding.");
+
+	// The texture is sampled through a 2D view, so 1D and 3D images are out.
+	if (layer_count > 1 || face_count != 1 || width == 0 || height == 0 || depth > 1)
+		throw std::runtime_error("Unsupported KTX2 texture type.");
+
+	FormatBlock block;
+	if (!formatBlock(static_cast<VkFormat>(vk_format), block))
+		throw std::runtime_error("Unsupported KTX2 format.");
+
+	image.format = static_cast<VkFormat>(vk_format);
+	image.dims = { width, height, 1 };
+
+	// A level count of 0 asks the loader to build the chain, we only upload what's there.
+	level_count = std::max(level_count, 1u);
+
+	uint32_t max_levels = 1;
+	while ((std::max(width, height) >> max_levels) != 0)
+		max_levels++;
+	if (level_count > max_levels)
+		throw std::runtime_error("KTX2 level count exceeds the mip chain.");
+
+	if (KTX2_HEADER_SIZE + level_count * KTX2_LEVEL_ENTRY_SIZE > size)
+		throw std::runtime_error("Truncated KTX2 level index.");
+
+	image.levels.resize(level_count);
+	for (uint32_t i = 0; i < level_count; i++) {
+		size_t entry = KTX2_HEADER_SIZE + i * KTX2_LEVEL_ENTRY_SIZE;
+		uint64_t offset = readValue<uint64_t>(data, entry);
+		uint64_t length = readValue<uint64_t>(data, entry + 8);
+
+		if (length == 0 || offset > size || length > size - offset)
+			throw std::runtime_error("Truncated KTX2 level data.");
+
+		Ktx2Level& level = image.levels[i];
+		level.dims = { std::max(width >> i, 1u), std::max(height >> i, 1u), 1 };
+
+		// The copy into the image reads whole blocks covering the level.
+		const uint64_t blocks_x = (level.dims[0] + block.width - 1) / block.width;
+		const uint64_t blocks_y = (level.dims[1] + block.height - 1) / block.height;
+		if (length != blocks_x * blocks_y * block.bytes)
+			throw std::runtime_error("KTX2 level size doesn't match its format.");
+
+		level.offset = static_cast<size_t>(offset);
+		level.size = static_cast<size_t>(length);
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef __KTX2__
+#define __KTX2__
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <vector>
+
+
+// One mip level of a KTX2 texture, as a byte range into the parsed file.
+struct Ktx2Level
+{
+    size_t offset = 0;
+    size_t size = 0;
+    std::array<uint32_t, 3> dims = { 1, 1, 1 };
+};
+
+// GPU-ready texture described by a KTX2 container. The level data is in
+// the layout Vulkan expects so it can be copied into staging as is.
+struct Ktx2Image
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    std::array<uint32_t, 3> dims = { 1, 1, 1 };
+    std::vector<Ktx2Level> levels;
+};
+
+
+// Parses the container in place, the levels reference data. Throws
+// std::runtime_error for anything other than a single layer, 2D,
+// non-supercompressed texture in one of the formats below, and for level
+// indices that don't match the image: more levels than the mip chain has,
+// or a level whose size isn't what its format and dimensions need.
+void parseKtx2(const char* data, size_t size, Ktx2Image& image);
+
+
+#endif // __KTX2__
@@ -23,18 +23,151 @@ Create and destroy a simple Vulkan instance.
 */
 
 
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
+#include "cpuprofiler.h"
 #include "vulkanprog.h"
 
 
-int main()
+static const char* const USAGE =
+	"Usage: vulkan-test [options]\n"
+	"  --frames N        frames in flight at startup (default 2)\n"
+	"  --max-frames N    frames allocated, the adaptive upper bound (default 3)\n"
+	"  --images N        swapchain images (default surface minimum + 1)\n"
+	"  --objects N       objects drawn each frame (default 1)\n"
+	"  --adaptive        adjust frames in flight to the measured load\n"
+	"  --present POLICY  latency, vsync, power or tearfree (default tearfree)\n"
+	"  --headless        render offscreen, no window or display needed\n"
+	"  --frame-count N   stop after N frames, required with --headless\n"
+	"  --bench N         measure N frames on a fixed clock and write them as JSON\n"
+	"  --warmup N        frames rendered before measuring (default 100)\n"
+	"  --bench-out PATH  benchmark output (default bench.json)\n"
+	"  --trace PATH      write CPU profiling zones as a Chrome trace, needs a\n"
+	"                    build with ENABLE_CPU_PROFILER (make PROFILE=1)\n"
+	"\n"
+	"F1-F4 switch between the present policies while running.\n";
+
+
+static uint32_t parseCount(int argc, char** argv, int& i, unsigned long max_value = 16, unsigned long min_value = 1)
+{
+	if (i + 1 >= argc)
+		throw std::runtime_error(std::string("Missing value for ") + argv[i]);
+
+	char* end = nullptr;
+	unsigned long value = std::strtoul(argv[++i], &end, 10);
+	if (*end != '\0' || value < min_value || value > max_value)
+		throw std::runtime_error(std::string("Invalid value for ") + argv[i - 1] + ": " + argv[i]);
+
+	return static_cast<uint32_t>(value);
+}
+
+static PresentPolicy parsePresentPolicy(int argc, char** argv, int& i)
+{
+	if (i + 1 >= argc)
+		throw std::runtime_error(std::string("Missing value for ") + argv[i]);
+
+	const char* name = argv[++i];
+	if (!strcmp(name, "latency"))
+		return PresentPolicy::LowestLatency;
+	if (!strcmp(name, "vsync"))
+		return PresentPolicy::VSync;
+	if (!strcmp(name, "power"))
+		return PresentPolicy::LowPower;
+	if (!strcmp(name, "tearfree"))
+		return PresentPolicy::TearFreeLowLatency;
+
+	throw std::runtime_error(std::string("Unknown present policy ") + name);
+}
+
+static RenderOptions parseOptions(int argc, char** argv)
+{
+	RenderOptions options;
+	bool max_given = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--frames"))
+			options.frames_in_flight = parseCount(argc, argv, i);
+		else if (!strcmp(argv[i], "--max-frames")) {
+			options.max_frames_in_flight = parseCount(argc, argv, i);
+			max_given = true;
+		}
+		else if (!strcmp(argv[i], "--images"))
+			options.swapchain_images = parseCount(argc, argv, i);
+		else if (!strcmp(argv[i], "--objects"))
+			options.object_count = parseCount(argc, argv, i, 65536);
+		else if (!strcmp(argv[i], "--adaptive"))
+			options.adaptive_frames = true;
+		else if (!strcmp(argv[i], "--present"))
+			options.present_policy = parsePresentPolicy(argc, argv, i);
+		else if (!strcmp(argv[i], "--headless"))
+			options.headless = true;
+		else if (!strcmp(argv[i], "--frame-count"))
+			options.frame_count = parseCount(argc, argv, i, UINT32_MAX);
+		else if (!strcmp(argv[i], "--bench"))
+			options.bench_frames = parseCount(argc, argv, i, UINT32_MAX / 2);
+		else if (!strcmp(argv[i], "--warmup"))
+			options.bench_warmup = parseCount(argc, argv, i, UINT32_MAX / 2, 0);
+		else if (!strcmp(argv[i], "--bench-out")) {
+			if (i + 1 >= argc)
+				throw std::runtime_error("Missing value for --bench-out");
+			options.bench_output = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--trace")) {
+#ifndef ENABLE_CPU_PROFILER
+			throw std::runtime_error("--trace needs a build with ENABLE_CPU_PROFILER defined.");
+#endif
+			if (i + 1 >= argc)
+				throw std::runtime_error("Missing value for --trace");
+			options.trace_output = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--help")) {
+			std::cout << USAGE;
+			std::exit(EXIT_SUCCESS);
+		}
+		else
+			throw std::runtime_error(std::string("Unknown option ") + argv[i] + "\n" + USAGE);
+	}
+
+	if (options.frames_in_flight > options.max_frames_in_flight) {
+		if (max_given)
+			throw std::runtime_error("--frames can't exceed --max-frames.");
+		options.max_frames_in_flight = options.frames_in_flight;
+	}
+
+	// The benchmark decides when the run ends.
+	if (options.bench_frames > 0)
+		options.frame_count = options.bench_warmup + options.bench_frames;
+
+	if (options.headless && options.frame_count == 0)
+		throw std::runtime_error("--headless needs --frame-count or --bench.");
+
+	return options;
+}
+
+
+int main(int argc, char** argv)
 {
 	VulkanProg prog;
 
 	try {
+		RenderOptions options = parseOptions(argc, argv);
+		CpuProfiler::setEnabled(!options.trace_output.empty());
+		PROFILE_THREAD("main");
+
+		prog.setOptions(options);
 		prog.run();
+
+		// After cleanup, so the trace covers teardown and the job threads
+		// have exited.
+		if (!options.trace_output.empty()) {
+			CpuProfiler::writeChromeTrace(options.trace_output.c_str());
+			std::cout << "Trace written to " << options.trace_output << std::endl;
+		}
 	}
 	catch (const std::exception& e) {
 		std::cerr << e.what() << std::endl;
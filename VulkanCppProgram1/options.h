@@ -0,0 +1,55 @@
+#ifndef __RENDER_OPTIONS__
+#define __RENDER_OPTIONS__
+
+#include <cstdint>
+#include <string>
+
+
+// Trade-off between latency, tearing and power used to pick a present mode.
+enum class PresentPolicy
+{
+    // IMMEDIATE, tears but shows each frame as soon as it is done.
+    LowestLatency,
+    // FIFO, every frame waits for a vertical blank and never tears.
+    VSync,
+    // FIFO with a single frame in flight and the adaptive pacer paused, so
+    // the CPU never works ahead of the GPU and both idle between refreshes.
+    LowPower,
+    // MAILBOX, renders freely and shows the newest finished frame without
+    // tearing.
+    TearFreeLowLatency,
+};
+
+
+// Settings chosen at startup, parsed from the command line by main(). The
+// present policy can also be switched while running.
+struct RenderOptions
+{
+    // Frames the CPU may run ahead of the GPU when rendering starts.
+    uint32_t frames_in_flight = 2;
+    // Per-frame resources are allocated for this many frames, it bounds
+    // what the adaptive controller may pick.
+    uint32_t max_frames_in_flight = 3;
+    // 0 asks for one more image than the surface minimum.
+    uint32_t swapchain_images = 0;
+    // Let the frame pacer move frames_in_flight within [1, max].
+    bool adaptive_frames = false;
+    // Objects drawn each frame, each with its own uniform slice.
+    uint32_t object_count = 1;
+    PresentPolicy present_policy = PresentPolicy::TearFreeLowLatency;
+    // Render into offscreen images without a window, surface or swapchain.
+    bool headless = false;
+    // Stop after this many frames, 0 runs until the window is closed.
+    uint32_t frame_count = 0;
+    // Frames measured by the benchmark, 0 disables it. The animation then
+    // runs on a fixed clock so every run renders the same frames.
+    uint32_t bench_frames = 0;
+    // Frames rendered before measuring starts.
+    uint32_t bench_warmup = 100;
+    std::string bench_output = "bench.json";
+    // Chrome trace of the profiling zones, written on exit when set.
+    std::string trace_output;
+};
+
+
+#endif // __RENDER_OPTIONS__
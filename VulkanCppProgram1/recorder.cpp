@@ -0,0 +1,115 @@
+#include "recorder.h"
+#include "cpuprofiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+// Below this many draws per slice the job overhead costs more than the
+// recording it spreads out.
+static const uint32_t MIN_ITEMS_PER_SLICE = 256;
+
+
+void CommandRecorder::init(VkDevice logical_device, uint32_t queue_family, JobSystem& jobs, uint32_t frame_count)
+{
+	m_logical_device = logical_device;
+	m_jobs = &jobs;
+	m_pools.resize(jobs.threadCount());
+
+	VkCommandPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = queue_family;
+	pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	for (auto& frames : m_pools) {
+		frames.resize(frame_count);
+		for (auto& pool : frames) {
+			if (vkCreateCommandPool(m_logical_device, &pool_info, nullptr, &pool.pool) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create recording command pool.");
+		}
+	}
+}
+
+void CommandRecorder::destroy()
+{
+	for (auto& frames : m_pools) {
+		for (auto& pool : frames)
+			vkDestroyCommandPool(m_logical_device, pool.pool, nullptr);
+	}
+
+	m_pools.clear();
+}
+
+void CommandRecorder::record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance,
+	uint32_t item_count, RecordFn fn, JobSystem::Counter& counter)
+{
+	// The frame's previous submission has completed and no job is using its
+	// pools yet, so they are recycled as a whole.
+	for (auto& frames : m_pools) {
+		vkResetCommandPool(m_logical_device, frames[frame].pool, 0);
+		frames[frame].used = 0;
+	}
+
+	uint32_t slice_count = (item_count + MIN_ITEMS_PER_SLICE - 1) / MIN_ITEMS_PER_SLICE;
+	slice_count = std::min(std::max(slice_count, 1u), m_jobs->threadCount());
+
+	m_frame = frame;
+	m_item_count = item_count;
+	m_slice_count = slice_count;
+	m_inheritance = inheritance;
+	m_fn = std::move(fn);
+	m_recorded.assign(slice_count, VK_NULL_HANDLE);
+
+	for (uint32_t slice = 0; slice < slice_count; slice++)
+		m_jobs->run([this, slice]() { recordSlice(slice); }, counter);
+}
+
+void CommandRecorder::recordSlice(uint32_t slice)
+{
+	PROFILE_FUNCTION();
+	// Whichever thread picked the job up records into its own pool.
+	ThreadPool& pool = m_pools[JobSystem::threadIndex()][m_frame];
+	VkCommandBuffer cmd_buffer = acquireCommandBuffer(pool);
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	begin_info.pInheritanceInfo = &m_inheritance;
+
+	if (vkBeginCommandBuffer(cmd_buffer, &begin_info) != VK_SUCCESS)
+		throw std::runtime_error("Failed to begin recording secondary command buffer.");
+
+	// Contiguous slices keep the draw order of the single-threaded path.
+	uint32_t per_slice = m_item_count / m_slice_count;
+	uint32_t remainder = m_item_count % m_slice_count;
+	uint32_t first = slice * per_slice + std::min(slice, remainder);
+	uint32_t count = per_slice + (slice < remainder ? 1 : 0);
+
+	if (count > 0)
+		m_fn(cmd_buffer, first, count);
+
+	if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to record secondary command buffer.");
+
+	m_recorded[slice] = cmd_buffer;
+}
+
+VkCommandBuffer CommandRecorder::acquireCommandBuffer(ThreadPool& pool)
+{
+	// A thread can end up with several slices of the same frame.
+	if (pool.used == pool.cmd_buffers.size()) {
+		VkCommandBufferAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.commandPool = pool.pool;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		alloc_info.commandBufferCount = 1;
+
+		VkCommandBuffer cmd_buffer;
+		if (vkAllocateCommandBuffers(m_logical_device, &alloc_info, &cmd_buffer) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate secondary command buffer.");
+
+		pool.cmd_buffers.push_back(cmd_buffer);
+	}
+
+	return pool.cmd_buffers[pool.used++];
+}
@@ -0,0 +1,60 @@
+#ifndef __COMMAND_RECORDER__
+#define __COMMAND_RECORDER__
+
+#include <vulkan/vulkan.hpp>
+
+#include "jobs.h"
+
+#include <functional>
+#include <vector>
+
+
+// Records a draw list into secondary command buffers as jobs. Every job
+// thread owns one transient command pool per frame in flight, so recording
+// never shares a pool between threads and a frame's pools can be reset
+// without touching the frames still in flight.
+class CommandRecorder
+{
+public:
+    // Records items [first, first + count) into cmd_buffer, which has already
+    // been begun inside the render pass.
+    using RecordFn = std::function<void(VkCommandBuffer cmd_buffer, uint32_t first, uint32_t count)>;
+
+    void init(VkDevice logical_device, uint32_t queue_family, JobSystem& jobs, uint32_t frame_count);
+    void destroy();
+
+    // Queues the slices of [0, item_count) as jobs against counter. Must be
+    // called from the thread that initialised the job system.
+    void record(uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance,
+        uint32_t item_count, RecordFn fn, JobSystem::Counter& counter);
+    // The secondaries of the last record(), in draw order, valid once its
+    // counter has drained.
+    const std::vector<VkCommandBuffer>& recorded() const { return m_recorded; }
+
+private:
+    struct ThreadPool
+    {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> cmd_buffers;
+        uint32_t used = 0;
+    };
+
+    void recordSlice(uint32_t slice);
+    VkCommandBuffer acquireCommandBuffer(ThreadPool& pool);
+
+    VkDevice m_logical_device = VK_NULL_HANDLE;
+    JobSystem* m_jobs = nullptr;
+    // Indexed by job thread, then frame.
+    std::vector<std::vector<ThreadPool>> m_pools;
+    std::vector<VkCommandBuffer> m_recorded;
+
+    // Current request, constant while its jobs run.
+    uint32_t m_frame = 0;
+    uint32_t m_item_count = 0;
+    uint32_t m_slice_count = 0;
+    VkCommandBufferInheritanceInfo m_inheritance = {};
+    RecordFn m_fn;
+};
+
+
+#endif // __COMMAND_RECORDER__
@@ -0,0 +1,80 @@
+#include "ringbuffer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+
+void UniformRing::init(DeviceAllocator& allocator, VkDevice logical_device, VkDeviceSize min_alignment,
+	VkDeviceSize element_size, uint32_t elements_per_slice, uint32_t slice_count)
+{
+	m_alignment = std::max<VkDeviceSize>(min_alignment, 1);
+	m_element_stride = alignedSize(element_size);
+	m_slice_size = m_element_stride * elements_per_slice;
+	m_slice_count = slice_count;
+
+	createBuffer(allocator, logical_device, m_slice_size * slice_count, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_buffer, m_alloc);
+}
+
+void UniformRing::destroy(DeviceAllocator& allocator, VkDevice logical_device)
+{
+	vkDestroyBuffer(logical_device, m_buffer, nullptr);
+	allocator.free(m_alloc);
+	m_buffer = VK_NULL_HANDLE;
+}
+
+void UniformRing::write(uint32_t slice, uint32_t index, const void* data, VkDeviceSize size)
+{
+	VkDeviceSize offset = sliceOffset(slice) + index * m_element_stride;
+	if (slice >= m_slice_count || size > m_element_stride || offset + size > sliceOffset(slice) + m_slice_size)
+		throw std::out_of_range("Uniform ring element out of range.");
+
+	memcpy(static_cast<char*>(m_alloc.mapped) + offset, data, static_cast<size_t>(size));
+}
+
+VkDeviceSize UniformRing::alignedSize(VkDeviceSize size) const
+{
+	return (size + m_alignment - 1) / m_alignment * m_alignment;
+}
+
+
+void StagingRing::init(DeviceAllocator& allocator, VkDevice logical_device, VkDeviceSize capacity)
+{
+	m_capacity = capacity;
+	m_read = 0;
+	m_write = 0;
+
+	createBuffer(allocator, logical_device, capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_buffer, m_alloc);
+}
+
+void StagingRing::destroy(DeviceAllocator& allocator, VkDevice logical_device)
+{
+	vkDestroyBuffer(logical_device, m_buffer, nullptr);
+	allocator.free(m_alloc);
+	m_buffer = VK_NULL_HANDLE;
+}
+
+bool StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	if (size > m_capacity)
+		return false;
+
+	// An idle ring restarts at the beginning of the buffer.
+	if (m_read == m_write)
+		m_read = m_write = (m_write + m_capacity - 1) / m_capacity * m_capacity;
+
+	VkDeviceSize position = (m_write + alignment - 1) / alignment * alignment;
+
+	// Never split a region across the end of the buffer, skip to the start instead.
+	VkDeviceSize physical = position % m_capacity;
+	if (physical + size > m_capacity)
+		position += m_capacity - physical;
+
+	if (position + size - m_read > m_capacity)
+		return false;
+
+	m_write = position + size;
+	offset = position % m_capacity;
+	return true;
+}
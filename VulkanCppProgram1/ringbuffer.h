@@ -0,0 +1,68 @@
+#ifndef __RING_BUFFER__
+#define __RING_BUFFER__
+
+#include <vulkan/vulkan.hpp>
+
+#include <algorithm>
+
+#include "allocator.h"
+
+
+// Persistently mapped uniform buffer split into equally sized slices, one
+// per frame. Each draw's uniforms live at a fixed element of the frame's
+// slice and are bound through VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+// offsets, so no map/unmap or descriptor update happens in the frame loop.
+class UniformRing
+{
+public:
+    void init(DeviceAllocator& allocator, VkDevice logical_device, VkDeviceSize min_alignment,
+        VkDeviceSize element_size, uint32_t elements_per_slice, uint32_t slice_count);
+    void destroy(DeviceAllocator& allocator, VkDevice logical_device);
+
+    // Writes element index of slice in place. There is no shared cursor, so
+    // distinct indices can be written from several threads.
+    void write(uint32_t slice, uint32_t index, const void* data, VkDeviceSize size);
+
+    VkDeviceSize alignedSize(VkDeviceSize size) const;
+    VkDeviceSize sliceOffset(uint32_t slice) const { return slice * m_slice_size; }
+    VkBuffer buffer() const { return m_buffer; }
+
+private:
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    Allocation m_alloc;
+    VkDeviceSize m_alignment = 1;
+    VkDeviceSize m_element_stride = 0;
+    VkDeviceSize m_slice_size = 0;
+    uint32_t m_slice_count = 0;
+};
+
+
+// Long-lived host-visible staging buffer used as a circular allocator.
+// Positions are handed out as monotonically increasing virtual offsets so
+// the owner can release everything up to a recorded position once the GPU
+// work that read it has completed.
+class StagingRing
+{
+public:
+    void init(DeviceAllocator& allocator, VkDevice logical_device, VkDeviceSize capacity);
+    void destroy(DeviceAllocator& allocator, VkDevice logical_device);
+
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+    void release(VkDeviceSize position) { m_read = std::max(m_read, position); }
+
+    VkDeviceSize position() const { return m_write; }
+    bool empty() const { return m_read == m_write; }
+    VkDeviceSize capacity() const { return m_capacity; }
+    VkBuffer buffer() const { return m_buffer; }
+    void* mapped(VkDeviceSize offset) const { return static_cast<char*>(m_alloc.mapped) + offset; }
+
+private:
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    Allocation m_alloc;
+    VkDeviceSize m_capacity = 0;
+    VkDeviceSize m_read = 0;
+    VkDeviceSize m_write = 0;
+};
+
+
+#endif // __RING_BUFFER__
@@ -0,0 +1,111 @@
+#include "taskgraph.h"
+#include "cpuprofiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+
+
+static double nowMs()
+{
+	using clock = std::chrono::steady_clock;
+	return std::chrono::duration<double, std::milli>(clock::now().time_since_epoch()).count();
+}
+
+
+TaskGraph::StepId TaskGraph::add(const char* name, std::initializer_list<StepId> dependencies, StepFn fn)
+{
+	const StepId id = static_cast<StepId>(m_steps.size());
+
+	for (StepId dependency : dependencies) {
+		if (dependency >= id)
+			throw std::runtime_error(std::string("Step ") + name + " depends on a step added after it.");
+	}
+
+	Step step;
+	step.name = name;
+	step.fn = std::move(fn);
+	step.dependencies = dependencies;
+	m_steps.push_back(std::move(step));
+
+	return id;
+}
+
+void TaskGraph::run(JobSystem& jobs)
+{
+	m_states = std::make_unique<StepState[]>(m_steps.size());
+	m_error = nullptr;
+	m_start_ms = nowMs();
+
+	// An empty job per dependency, queued once that dependency is done,
+	// joins them into the step's ready counter.
+	for (StepId id = 0; id < m_steps.size(); id++) {
+		StepState& state = m_states[id];
+		for (StepId dependency : m_steps[id].dependencies)
+			jobs.after(m_states[dependency].done, []() {}, state.ready);
+		jobs.after(state.ready, [this, id]() { runStep(id); }, state.done);
+	}
+
+	for (StepId id = 0; id < m_steps.size(); id++)
+		jobs.wait(m_states[id].done);
+	m_elapsed_ms = nowMs() - m_start_ms;
+
+	if (m_error)
+		std::rethrow_exception(m_error);
+}
+
+void TaskGraph::runStep(StepId id)
+{
+	Step& step = m_steps[id];
+	StepState& state = m_states[id];
+
+	for (StepId dependency : step.dependencies) {
+		if (m_states[dependency].failed.load(std::memory_order_relaxed)) {
+			state.failed.store(true, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	step.thread = JobSystem::threadIndex();
+	step.start_ms = nowMs() - m_start_ms;
+	try {
+		PROFILE_ZONE(step.name);
+		step.fn();
+	}
+	catch (...) {
+		state.failed.store(true, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> lock(m_error_mutex);
+		if (!m_error)
+			m_error = std::current_exception();
+	}
+	step.end_ms = nowMs() - m_start_ms;
+}
+
+void TaskGraph::log(std::ostream& out) const
+{
+	std::vector<const Step*> order;
+	double busy_ms = 0.0;
+	for (const auto& step : m_steps) {
+		order.push_back(&step);
+		busy_ms += step.end_ms - step.start_ms;
+	}
+
+	std::sort(order.begin(), order.end(), [](const Step* a, const Step* b) { return a->start_ms < b->start_ms; });
+
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+
+	for (const Step* step : order) {
+		out << "  " << std::left << std::setw(24) << step->name << std::right
+			<< std::setw(8) << step->start_ms << " ms +" << std::setw(7) << step->end_ms - step->start_ms
+			<< " ms  thread " << step->thread << "\n";
+	}
+	out << "  " << m_elapsed_ms << " ms wall, " << busy_ms << " ms of steps" << std::endl;
+
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,74 @@
+#ifndef __TASK_GRAPH__
+#define __TASK_GRAPH__
+
+#include "jobs.h"
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+
+// Runs a set of named steps on the job system, each one as soon as the
+// steps it depends on have finished, and records when and where each ran.
+// Dependencies can only name steps added earlier, so the graph can't have
+// cycles. Ordering is left to JobSystem::after(), the graph only adds the
+// join over several dependencies.
+class TaskGraph
+{
+public:
+    using StepId = uint32_t;
+    using StepFn = std::function<void()>;
+
+    struct Step
+    {
+        // Must outlive the graph, it also names the step's profiling zone.
+        const char* name = nullptr;
+        StepFn fn;
+        std::vector<StepId> dependencies;
+
+        // Relative to the start of run(), in milliseconds.
+        double start_ms = 0.0;
+        double end_ms = 0.0;
+        uint32_t thread = 0;
+    };
+
+    StepId add(const char* name, std::initializer_list<StepId> dependencies, StepFn fn);
+
+    // Blocks until every step has run, helping with the jobs meanwhile. If a
+    // step throws, the steps depending on it are skipped and the first
+    // error is rethrown once the others are done.
+    void run(JobSystem& jobs);
+
+    // One line per step in start order, then the wall time against the sum
+    // of the step times.
+    void log(std::ostream& out) const;
+
+private:
+    struct StepState
+    {
+        // Drains once every dependency is done.
+        JobSystem::Counter ready;
+        // Drains once the step ran or was skipped.
+        JobSystem::Counter done;
+        // Set when the step threw or was skipped, its dependents skip too.
+        std::atomic<bool> failed{ false };
+    };
+
+    void runStep(StepId id);
+
+    std::vector<Step> m_steps;
+    std::unique_ptr<StepState[]> m_states;
+    std::mutex m_error_mutex;
+    std::exception_ptr m_error;
+    double m_start_ms = 0.0;
+    double m_elapsed_ms = 0.0;
+};
+
+
+#endif // __TASK_GRAPH__
@@ -0,0 +1,91 @@
+// Builds an asset pack from loose files. Each file is stored under the path
+// given on the command line, which is the name the runtime looks it up by.
+//
+// Usage: asset-pack <output.pack> <file>...
+
+#include "../assetpack.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+
+static std::vector<char> readFile(const std::string& path)
+{
+	std::ifstream fp(path, std::ios::ate | std::ios::binary);
+
+	if (!fp.is_open())
+		throw std::runtime_error("Failed to open " + path);
+
+	size_t size = (size_t)fp.tellg();
+	std::vector<char> buffer(size);
+
+	fp.seekg(0);
+	fp.read(buffer.data(), size);
+
+	return buffer;
+}
+
+
+int main(int argc, char** argv)
+{
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <output.pack> <file>..." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	try {
+		const uint32_t entry_count = static_cast<uint32_t>(argc - 2);
+
+		PackHeader header = {};
+		memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+		header.version = PACK_VERSION;
+		header.entry_count = entry_count;
+		header.alignment = PACK_ALIGNMENT;
+
+		std::vector<PackEntry> entries(entry_count);
+		std::vector<std::vector<char>> payloads(entry_count);
+
+		uint64_t offset = sizeof(PackHeader) + sizeof(PackEntry) * entry_count;
+		for (uint32_t i = 0; i < entry_count; i++) {
+			std::string name = argv[i + 2];
+			if (name.size() >= sizeof(entries[i].name))
+				throw std::runtime_error("Asset name too long: " + name);
+
+			payloads[i] = readFile(name);
+
+			memset(&entries[i], 0, sizeof(PackEntry));
+			memcpy(entries[i].name, name.c_str(), name.size());
+			offset = (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+			entries[i].offset = offset;
+			entries[i].size = payloads[i].size();
+			offset += payloads[i].size();
+		}
+
+		std::ofstream fp(argv[1], std::ios::binary);
+		if (!fp.is_open())
+			throw std::runtime_error("Failed to open output file.");
+
+		fp.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		fp.write(reinterpret_cast<const char*>(entries.data()), sizeof(PackEntry) * entry_count);
+
+		uint64_t position = sizeof(PackHeader) + sizeof(PackEntry) * entry_count;
+		const std::vector<char> padding(PACK_ALIGNMENT, 0);
+		for (uint32_t i = 0; i < entry_count; i++) {
+			fp.write(padding.data(), static_cast<std::streamsize>(entries[i].offset - position));
+			fp.write(payloads[i].data(), static_cast<std::streamsize>(payloads[i].size()));
+			position = entries[i].offset + payloads[i].size();
+		}
+
+		std::cout << argv[1] << ": " << entry_count << " assets, " << position << " bytes" << std::endl;
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,395 @@
+// Offline texture cooker: decodes an image with stb_image, builds the full
+// mip chain, encodes every level to BC1 (opaque) or BC3 (with alpha) and
+// writes the result as a KTX2 container the runtime can upload as is.
+//
+// Usage: texture-cook <input image> <output.ktx2>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COOK_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+// VkFormat values, the cooker doesn't need the Vulkan headers.
+static const uint32_t FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+static const uint32_t FORMAT_BC3_UNORM_BLOCK = 137;
+
+// Khronos Data Format descriptor values used in the DFD.
+static const uint8_t KHR_DF_MODEL_BC1A = 128;
+static const uint8_t KHR_DF_MODEL_BC3 = 130;
+static const uint8_t KHR_DF_CHANNEL_COLOR = 0;
+static const uint8_t KHR_DF_CHANNEL_ALPHA = 15;
+static const uint8_t KHR_DF_PRIMARIES_BT709 = 1;
+static const uint8_t KHR_DF_TRANSFER_LINEAR = 1;
+
+static const uint8_t KTX2_IDENTIFIER[12] = {
+	0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+
+struct Level
+{
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> pixels;
+};
+
+
+static void downsampleRow(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, uint32_t src_width, uint32_t dst_width)
+{
+	uint32_t x = 0;
+
+#ifdef COOK_USE_SSE2
+	// Four source pixels from each row make two destination pixels per step.
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(2);
+
+	for (; x + 2 <= dst_width && 2 * x + 4 <= src_width; x += 2) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x));
+
+		__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+		__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+		// Fold each pair of horizontally adjacent pixels into the low half.
+		lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+		hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+		__m128i sum = _mm_unpacklo_epi64(lo, hi);
+		sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 4 * x), _mm_packus_epi16(sum, zero));
+	}
+#endif
+
+	for (; x < dst_width; x++) {
+		uint32_t x0 = std::min(2 * x, src_width - 1);
+		uint32_t x1 = std::min(2 * x + 1, src_width - 1);
+
+		for (uint32_t c = 0; c < 4; c++) {
+			uint32_t sum = row0[4 * x0 + c] + row0[4 * x1 + c] + row1[4 * x0 + c] + row1[4 * x1 + c];
+			dst[4 * x + c] = static_cast<uint8_t>((sum + 2) / 4);
+		}
+	}
+}
+
+static Level downsample(const Level& src)
+{
+	Level dst;
+	dst.width = std::max(src.width / 2, 1u);
+	dst.height = std::max(src.height / 2, 1u);
+	dst.pixels.resize(static_cast<size_t>(dst.width) * dst.height * 4);
+
+	const size_t src_pitch = static_cast<size_t>(src.width) * 4;
+	for (uint32_t y = 0; y < dst.height; y++) {
+		uint32_t y0 = std::min(2 * y, src.height - 1);
+		uint32_t y1 = std::min(2 * y + 1, src.height - 1);
+
+		downsampleRow(src.pixels.data() + y0 * src_pitch, src.pixels.data() + y1 * src_pitch,
+			dst.pixels.data() + static_cast<size_t>(y) * dst.width * 4, src.width, dst.width);
+	}
+
+	return dst;
+}
+
+
+static uint16_t packColor(const uint8_t* c)
+{
+	uint32_t r = (c[0] * 31 + 127) / 255;
+	uint32_t g = (c[1] * 63 + 127) / 255;
+	uint32_t b = (c[2] * 31 + 127) / 255;
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpackColor(uint16_t packed, int* c)
+{
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 colour block in four-colour mode, endpoints from the inset bounding box.
+static void encodeColorBlock(const uint8_t* block, uint8_t* out)
+{
+	uint8_t min_c[3] = { 255, 255, 255 };
+	uint8_t max_c[3] = { 0, 0, 0 };
+
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			min_c[c] = std::min(min_c[c], block[4 * i + c]);
+			max_c[c] = std::max(max_c[c], block[4 * i + c]);
+		}
+	}
+
+	for (int c = 0; c < 3; c++) {
+		uint8_t inset = static_cast<uint8_t>((max_c[c] - min_c[c]) >> 4);
+		min_c[c] += inset;
+		max_c[c] -= inset;
+	}
+
+	uint16_t c0 = packColor(max_c);
+	uint16_t c1 = packColor(min_c);
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1) {
+		int palette[4][3];
+		unpackColor(c0, palette[0]);
+		unpackColor(c1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			int best_dist = 1 << 30;
+			for (int p = 0; p < 4; p++) {
+				int dist = 0;
+				for (int c = 0; c < 3; c++) {
+					int d = block[4 * i + c] - palette[p][c];
+					dist += d * d;
+				}
+				if (dist < best_dist) {
+					best_dist = dist;
+					best = p;
+				}
+			}
+			indices |= static_cast<uint32_t>(best) << (2 * i);
+		}
+	}
+
+	out[0] = static_cast<uint8_t>(c0 & 0xFF);
+	out[1] = static_cast<uint8_t>(c0 >> 8);
+	out[2] = static_cast<uint8_t>(c1 & 0xFF);
+	out[3] = static_cast<uint8_t>(c1 >> 8);
+	memcpy(out + 4, &indices, 4);
+}
+
+// BC3 alpha block in eight-value mode.
+static void encodeAlphaBlock(const uint8_t* block, uint8_t* out)
+{
+	uint8_t a0 = 0;
+	uint8_t a1 = 255;
+	for (int i = 0; i < 16; i++) {
+		a0 = std::max(a0, block[4 * i + 3]);
+		a1 = std::min(a1, block[4 * i + 3]);
+	}
+
+	uint64_t indices = 0;
+	if (a0 != a1) {
+		int palette[8] = { a0, a1 };
+		for (int p = 1; p < 7; p++)
+			palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			int best_dist = 256;
+			for (int p = 0; p < 8; p++) {
+				int dist = std::abs(block[4 * i + 3] - palette[p]);
+				if (dist < best_dist) {
+					best_dist = dist;
+					best = p;
+				}
+			}
+			indices |= static_cast<uint64_t>(best) << (3 * i);
+		}
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+static std::vector<uint8_t> encodeLevel(const Level& level, bool alpha)
+{
+	const uint32_t blocks_x = (level.width + 3) / 4;
+	const uint32_t blocks_y = (level.height + 3) / 4;
+	const size_t block_bytes = alpha ? 16 : 8;
+
+	std::vector<uint8_t> out(blocks_x * blocks_y * block_bytes);
+	uint8_t block[64];
+
+	for (uint32_t by = 0; by < blocks_y; by++) {
+		for (uint32_t bx = 0; bx < blocks_x; bx++) {
+			// Edge blocks repeat the last row and column of the level.
+			for (uint32_t y = 0; y < 4; y++) {
+				uint32_t sy = std::min(by * 4 + y, level.height - 1);
+				for (uint32_t x = 0; x < 4; x++) {
+					uint32_t sx = std::min(bx * 4 + x, level.width - 1);
+					memcpy(block + 4 * (4 * y + x), level.pixels.data() + (static_cast<size_t>(sy) * level.width + sx) * 4, 4);
+				}
+			}
+
+			uint8_t* dst = out.data() + (static_cast<size_t>(by) * blocks_x + bx) * block_bytes;
+			if (alpha) {
+				encodeAlphaBlock(block, dst);
+				encodeColorBlock(block, dst + 8);
+			}
+			else {
+				encodeColorBlock(block, dst);
+			}
+		}
+	}
+
+	return out;
+}
+
+
+template<typename T>
+static void writeValue(std::vector<uint8_t>& file, size_t offset, T value)
+{
+	memcpy(file.data() + offset, &value, sizeof(T));
+}
+
+static std::vector<uint8_t> buildDfd(bool alpha)
+{
+	struct Sample { uint16_t bit_offset; uint8_t bit_length; uint8_t channel; };
+	std::vector<Sample> samples;
+	if (alpha) {
+		samples.push_back({ 0, 63, KHR_DF_CHANNEL_ALPHA });
+		samples.push_back({ 64, 63, KHR_DF_CHANNEL_COLOR });
+	}
+	else {
+		samples.push_back({ 0, 63, KHR_DF_CHANNEL_COLOR });
+	}
+
+	const uint16_t block_size = static_cast<uint16_t>(24 + 16 * samples.size());
+	std::vector<uint8_t> dfd(4 + block_size, 0);
+
+	writeValue<uint32_t>(dfd, 0, static_cast<uint32_t>(dfd.size()));
+	writeValue<uint32_t>(dfd, 4, 0);
+	writeValue<uint16_t>(dfd, 8, 2);
+	writeValue<uint16_t>(dfd, 10, block_size);
+	dfd[12] = alpha ? KHR_DF_MODEL_BC3 : KHR_DF_MODEL_BC1A;
+	dfd[13] = KHR_DF_PRIMARIES_BT709;
+	dfd[14] = KHR_DF_TRANSFER_LINEAR;
+	dfd[15] = 0;
+	dfd[16] = 3;
+	dfd[17] = 3;
+	dfd[20] = alpha ? 16 : 8;
+
+	for (size_t i = 0; i < samples.size(); i++) {
+		size_t base = 28 + 16 * i;
+		writeValue<uint16_t>(dfd, base, samples[i].bit_offset);
+		dfd[base + 2] = samples[i].bit_length;
+		dfd[base + 3] = samples[i].channel;
+		writeValue<uint32_t>(dfd, base + 8, 0);
+		writeValue<uint32_t>(dfd, base + 12, 0xFFFFFFFF);
+	}
+
+	return dfd;
+}
+
+static void writeKtx2(const std::string& path, uint32_t width, uint32_t height, bool alpha,
+	const std::vector<std::vector<uint8_t>>& levels)
+{
+	const size_t header_size = 80;
+	const size_t level_index_size = 24 * levels.size();
+	const size_t block_bytes = alpha ? 16 : 8;
+	std::vector<uint8_t> dfd = buildDfd(alpha);
+
+	// Level data follows the DFD, smallest level first, each aligned to the block size.
+	size_t dfd_offset = header_size + level_index_size;
+	size_t data_offset = dfd_offset + dfd.size();
+	std::vector<size_t> level_offsets(levels.size());
+	for (size_t i = levels.size(); i-- > 0;) {
+		data_offset = (data_offset + block_bytes - 1) / block_bytes * block_bytes;
+		level_offsets[i] = data_offset;
+		data_offset += levels[i].size();
+	}
+
+	std::vector<uint8_t> file(data_offset, 0);
+	memcpy(file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	writeValue<uint32_t>(file, 12, alpha ? FORMAT_BC3_UNORM_BLOCK : FORMAT_BC1_RGB_UNORM_BLOCK);
+	writeValue<uint32_t>(file, 16, 1);
+	writeValue<uint32_t>(file, 20, width);
+	writeValue<uint32_t>(file, 24, height);
+	writeValue<uint32_t>(file, 28, 0);
+	writeValue<uint32_t>(file, 32, 0);
+	writeValue<uint32_t>(file, 36, 1);
+	writeValue<uint32_t>(file, 40, static_cast<uint32_t>(levels.size()));
+	writeValue<uint32_t>(file, 44, 0);
+	writeValue<uint32_t>(file, 48, static_cast<uint32_t>(dfd_offset));
+	writeValue<uint32_t>(file, 52, static_cast<uint32_t>(dfd.size()));
+
+	for (size_t i = 0; i < levels.size(); i++) {
+		size_t entry = header_size + 24 * i;
+		writeValue<uint64_t>(file, entry, level_offsets[i]);
+		writeValue<uint64_t>(file, entry + 8, levels[i].size());
+		writeValue<uint64_t>(file, entry + 16, levels[i].size());
+		memcpy(file.data() + level_offsets[i], levels[i].data(), levels[i].size());
+	}
+
+	memcpy(file.data() + dfd_offset, dfd.data(), dfd.size());
+
+	std::ofstream fp(path, std::ios::binary);
+	if (!fp.is_open())
+		throw std::runtime_error("Failed to open output file.");
+
+	fp.write(reinterpret_cast<const char*>(file.data()), file.size());
+}
+
+
+int main(int argc, char** argv)
+{
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <input image> <output.ktx2>" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	try {
+		int width, height, channels;
+		stbi_uc* pixels = stbi_load(argv[1], &width, &height, &channels, STBI_rgb_alpha);
+		if (!pixels)
+			throw std::runtime_error("Failed to load texture.");
+
+		Level base;
+		base.width = static_cast<uint32_t>(width);
+		base.height = static_cast<uint32_t>(height);
+		base.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+		stbi_image_free(pixels);
+
+		bool alpha = false;
+		for (size_t i = 3; i < base.pixels.size(); i += 4)
+			alpha |= base.pixels[i] != 255;
+
+		std::vector<std::vector<uint8_t>> encoded;
+		Level level = std::move(base);
+		for (;;) {
+			encoded.push_back(encodeLevel(level, alpha));
+			if (level.width == 1 && level.height == 1)
+				break;
+			level = downsample(level);
+		}
+
+		writeKtx2(argv[2], static_cast<uint32_t>(width), static_cast<uint32_t>(height), alpha, encoded);
+
+		std::cout << argv[2] << ": " << width << "x" << height << ", " << encoded.size() << " levels, "
+			<< (alpha ? "BC3" : "BC1") << std::endl;
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
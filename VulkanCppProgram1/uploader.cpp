@@ -0,0 +1,547 @@
+#include "uploader.h"
+#include "cpuprofiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+
+static VkSemaphore createTimeline(VkDevice logical_device)
+{
+	VkSemaphoreTypeCreateInfo type_info = {};
+	type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	type_info.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphore_info = {};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphore_info.pNext = &type_info;
+
+	VkSemaphore semaphore;
+	if (vkCreateSemaphore(logical_device, &semaphore_info, nullptr, &semaphore) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create upload timeline semaphore.");
+
+	return semaphore;
+}
+
+
+void Uploader::init(DeviceAllocator& allocator, VkPhysicalDevice phys_device, VkDevice logical_device,
+	VkQueue graphics_queue, uint32_t graphics_family, VkQueue transfer_queue, uint32_t transfer_family,
+	VkDeviceSize staging_size, GpuProfiler* profiler)
+{
+	m_allocator = &allocator;
+	m_logical_device = logical_device;
+	m_graphics_queue = graphics_queue;
+	m_transfer_queue = transfer_queue;
+	m_graphics_family = graphics_family;
+	m_transfer_family = transfer_family;
+	m_profiler = profiler;
+	if (m_profiler) {
+		m_copy_region = m_profiler->region("upload");
+		m_acquire_region = m_profiler->region("upload acquire");
+	}
+
+	VkPhysicalDeviceProperties dev_props;
+	vkGetPhysicalDeviceProperties(phys_device, &dev_props);
+	m_image_alignment = std::max<VkDeviceSize>(dev_props.limits.optimalBufferCopyOffsetAlignment, 16);
+
+	VkCommandPoolCreateInfo pool_info = {};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.queueFamilyIndex = transfer_family;
+	pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	if (vkCreateCommandPool(m_logical_device, &pool_info, nullptr, &m_transfer_pool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create upload command pool.");
+
+	if (splitQueues()) {
+		pool_info.queueFamilyIndex = graphics_family;
+
+		if (vkCreateCommandPool(m_logical_device, &pool_info, nullptr, &m_graphics_pool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create upload command pool.");
+
+		m_transfer_timeline = createTimeline(m_logical_device);
+	}
+
+	m_timeline = createTimeline(m_logical_device);
+	m_next_ticket = 1;
+	m_completed_ticket = 0;
+
+	// Keep the capacity a multiple of every copy alignment we hand out.
+	const VkDeviceSize granularity = 64 * 1024;
+	m_staging.init(allocator, logical_device, (staging_size + granularity - 1) / granularity * granularity);
+}
+
+void Uploader::destroy()
+{
+	if (!m_pending.empty())
+		flush();
+
+	collect(m_next_ticket - 1);
+
+	vkDestroySemaphore(m_logical_device, m_timeline, nullptr);
+	if (m_transfer_timeline != VK_NULL_HANDLE)
+		vkDestroySemaphore(m_logical_device, m_transfer_timeline, nullptr);
+	m_timeline = VK_NULL_HANDLE;
+	m_transfer_timeline = VK_NULL_HANDLE;
+	m_free_transfer_cmds.clear();
+	m_free_graphics_cmds.clear();
+
+	vkDestroyCommandPool(m_logical_device, m_transfer_pool, nullptr);
+	if (m_graphics_pool != VK_NULL_HANDLE)
+		vkDestroyCommandPool(m_logical_device, m_graphics_pool, nullptr);
+	m_graphics_pool = VK_NULL_HANDLE;
+	m_staging.destroy(*m_allocator, m_logical_device);
+}
+
+void Uploader::uploadBuffer(VkBuffer dst, const void* data, VkDeviceSize size, VkDeviceSize dst_offset)
+{
+	CopyOp op;
+	stage(data, size, 16, op.src, op.src_offset);
+	op.dst_buffer = dst;
+	op.dst_offset = dst_offset;
+	op.size = size;
+
+	m_pending.push_back(op);
+}
+
+void Uploader::uploadImage(VkImage dst, const void* data, VkDeviceSize size, const std::array<uint32_t, 3>& dims,
+	uint32_t mip_levels, VkImageLayout final_layout)
+{
+	CopyOp op;
+	stage(data, size, m_image_alignment, op.src, op.src_offset);
+	op.dst_image = dst;
+	op.size = size;
+	op.extent = { dims[0], dims[1], dims[2] };
+	op.mip_levels = mip_levels;
+	op.final_layout = final_layout;
+
+	m_pending.push_back(op);
+}
+
+void Uploader::uploadImageLevel(VkImage dst, const void* data, VkDeviceSize size, const std::array<uint32_t, 3>& dims,
+	uint32_t level, VkImageLayout final_layout)
+{
+	CopyOp op;
+	stage(data, size, m_image_alignment, op.src, op.src_offset);
+	op.dst_image = dst;
+	op.size = size;
+	op.extent = { dims[0], dims[1], dims[2] };
+	op.level = level;
+	op.final_layout = final_layout;
+
+	m_pending.push_back(op);
+}
+
+uint64_t Uploader::flush()
+{
+	PROFILE_FUNCTION();
+	if (m_pending.empty())
+		return m_next_ticket - 1;
+
+	collect(0);
+
+	Submission submission;
+	submission.ticket = m_next_ticket++;
+	submission.staging_end = m_staging.position();
+	submission.temp_buffers.swap(m_pending_temp);
+
+	submission.transfer_cmd = acquireCommandBuffer(m_transfer_pool, m_free_transfer_cmds);
+	if (splitQueues())
+		submission.graphics_cmd = acquireCommandBuffer(m_graphics_pool, m_free_graphics_cmds);
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(submission.transfer_cmd, &begin_info);
+	if (splitQueues())
+		vkBeginCommandBuffer(submission.graphics_cmd, &begin_info);
+
+	GpuProfiler::Scope copy_scope = GpuProfiler::NO_SCOPE;
+	GpuProfiler::Scope acquire_scope = GpuProfiler::NO_SCOPE;
+	if (m_profiler) {
+		copy_scope = m_profiler->begin(submission.transfer_cmd, m_transfer_family, m_copy_region, submission.ticket);
+		if (splitQueues())
+			acquire_scope = m_profiler->begin(submission.graphics_cmd, m_graphics_family, m_acquire_region, submission.ticket);
+	}
+
+	record(submission.transfer_cmd, splitQueues() ? submission.graphics_cmd : submission.transfer_cmd);
+
+	if (m_profiler) {
+		m_profiler->end(submission.transfer_cmd, copy_scope);
+		m_profiler->end(submission.graphics_cmd, acquire_scope);
+	}
+
+	vkEndCommandBuffer(submission.transfer_cmd);
+	if (splitQueues())
+		vkEndCommandBuffer(submission.graphics_cmd);
+
+	// Both sides signal the ticket itself, on their own timeline.
+	VkTimelineSemaphoreSubmitInfo timeline_info = {};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.signalSemaphoreValueCount = 1;
+	timeline_info.pSignalSemaphoreValues = &submission.ticket;
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = &timeline_info;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &submission.transfer_cmd;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = splitQueues() ? &m_transfer_timeline : &m_timeline;
+
+	if (vkQueueSubmit(m_transfer_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+		throw std::runtime_error("Failed to submit upload command buffer.");
+
+	if (splitQueues()) {
+		// The graphics side only holds the acquire barriers, so it may block
+		// every stage until the copies have landed.
+		VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+		VkTimelineSemaphoreSubmitInfo acquire_timeline_info = {};
+		acquire_timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		acquire_timeline_info.waitSemaphoreValueCount = 1;
+		acquire_timeline_info.pWaitSemaphoreValues = &submission.ticket;
+		acquire_timeline_info.signalSemaphoreValueCount = 1;
+		acquire_timeline_info.pSignalSemaphoreValues = &submission.ticket;
+
+		VkSubmitInfo acquire_info = {};
+		acquire_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquire_info.pNext = &acquire_timeline_info;
+		acquire_info.waitSemaphoreCount = 1;
+		acquire_info.pWaitSemaphores = &m_transfer_timeline;
+		acquire_info.pWaitDstStageMask = &wait_stage;
+		acquire_info.commandBufferCount = 1;
+		acquire_info.pCommandBuffers = &submission.graphics_cmd;
+		acquire_info.signalSemaphoreCount = 1;
+		acquire_info.pSignalSemaphores = &m_timeline;
+
+		if (vkQueueSubmit(m_graphics_queue, 1, &acquire_info, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Failed to submit upload acquire command buffer.");
+	}
+
+	m_pending.clear();
+	m_in_flight.push_back(std::move(submission));
+
+	return m_next_ticket - 1;
+}
+
+void Uploader::stage(const void* data, VkDeviceSize size, VkDeviceSize alignment, VkBuffer& buffer, VkDeviceSize& offset)
+{
+	PROFILE_FUNCTION();
+	// Anything larger than the whole ring gets a one-off buffer that is
+	// released together with the submission that reads it.
+	if (size > m_staging.capacity()) {
+		TempBuffer temp;
+		createBuffer(*m_allocator, m_logical_device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, temp.buffer, temp.alloc);
+		memcpy(temp.alloc.mapped, data, static_cast<size_t>(size));
+
+		buffer = temp.buffer;
+		offset = 0;
+		m_pending_temp.push_back(temp);
+		return;
+	}
+
+	while (!m_staging.allocate(size, alignment, offset)) {
+		// Queued copies pin ring space until they are submitted, after that
+		// the only way to make room is to wait for the oldest submission.
+		if (!m_pending.empty())
+			flush();
+		else if (!m_in_flight.empty())
+			collect(m_in_flight.front().ticket);
+		else
+			throw std::runtime_error("Failed to allocate staging memory.");
+	}
+
+	memcpy(m_staging.mapped(offset), data, static_cast<size_t>(size));
+	buffer = m_staging.buffer();
+}
+
+void Uploader::collect(uint64_t wait_ticket)
+{
+	// One counter read covers every submission, they complete in order.
+	uint64_t completed = 0;
+	if (wait_ticket > m_completed_ticket) {
+		PROFILE_ZONE("wait upload");
+		VkSemaphoreWaitInfo wait_info = {};
+		wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		wait_info.semaphoreCount = 1;
+		wait_info.pSemaphores = &m_timeline;
+		wait_info.pValues = &wait_ticket;
+
+		vkWaitSemaphores(m_logical_device, &wait_info, std::numeric_limits<uint64_t>::max());
+	}
+	vkGetSemaphoreCounterValue(m_logical_device, m_timeline, &completed);
+
+	while (!m_in_flight.empty() && m_in_flight.front().ticket <= completed) {
+		retire(m_in_flight.front());
+		m_in_flight.pop_front();
+	}
+}
+
+void Uploader::retire(Submission& submission)
+{
+	m_staging.release(submission.staging_end);
+
+	for (auto& temp : submission.temp_buffers) {
+		vkDestroyBuffer(m_logical_device, temp.buffer, nullptr);
+		m_allocator->free(temp.alloc);
+	}
+
+	m_free_transfer_cmds.push_back(submission.transfer_cmd);
+	if (submission.graphics_cmd != VK_NULL_HANDLE)
+		m_free_graphics_cmds.push_back(submission.graphics_cmd);
+	m_completed_ticket = submission.ticket;
+}
+
+VkCommandBuffer Uploader::acquireCommandBuffer(VkCommandPool pool, std::vector<VkCommandBuffer>& free_list)
+{
+	if (!free_list.empty()) {
+		VkCommandBuffer cmd_buffer = free_list.back();
+		free_list.pop_back();
+		return cmd_buffer;
+	}
+
+	VkCommandBufferAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandPool = pool;
+	alloc_info.commandBufferCount = 1;
+
+	VkCommandBuffer cmd_buffer;
+	if (vkAllocateCommandBuffers(m_logical_device, &alloc_info, &cmd_buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate upload command buffer.");
+
+	return cmd_buffer;
+}
+
+void Uploader::record(VkCommandBuffer transfer_cmd, VkCommandBuffer graphics_cmd)
+{
+	// Every image in the batch enters TRANSFER_DST in one barrier, all copies
+	// follow, and a second barrier hands every destination to its consumer.
+	// With separate families that second barrier is split into a release on
+	// the transfer queue and an identical acquire on the graphics queue.
+	const bool split = splitQueues();
+	const uint32_t src_family = split ? m_transfer_family : VK_QUEUE_FAMILY_IGNORED;
+	const uint32_t dst_family = split ? m_graphics_family : VK_QUEUE_FAMILY_IGNORED;
+	const VkAccessFlags read_access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+		VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	const VkPipelineStageFlags read_stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	std::vector<VkImageMemoryBarrier> to_transfer;
+	std::vector<VkImageMemoryBarrier> to_final;
+	std::vector<VkBufferMemoryBarrier> buffer_handoff;
+
+	for (const auto& op : m_pending) {
+		if (op.dst_image == VK_NULL_HANDLE) {
+			if (!split)
+				continue;
+
+			VkBufferMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = src_family;
+			barrier.dstQueueFamilyIndex = dst_family;
+			barrier.buffer = op.dst_buffer;
+			barrier.offset = op.dst_offset;
+			barrier.size = op.size;
+			buffer_handoff.push_back(barrier);
+			continue;
+		}
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = op.dst_image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = op.level;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		to_transfer.push_back(barrier);
+
+		barrier.srcQueueFamilyIndex = src_family;
+		barrier.dstQueueFamilyIndex = dst_family;
+		// Images that get a mip chain hand level 0 over as the first blit source.
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = op.mip_levels > 1 ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : op.final_layout;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = op.mip_levels > 1 ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT;
+		to_final.push_back(barrier);
+	}
+
+	if (!to_transfer.empty())
+		vkCmdPipelineBarrier(transfer_cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			static_cast<uint32_t>(to_transfer.size()), to_transfer.data());
+
+	for (const auto& op : m_pending) {
+		if (op.dst_image != VK_NULL_HANDLE) {
+			VkBufferImageCopy region = {};
+			region.bufferOffset = op.src_offset;
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = op.level;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { 0, 0, 0 };
+			region.imageExtent = op.extent;
+
+			vkCmdCopyBufferToImage(transfer_cmd, op.src, op.dst_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		}
+		else {
+			VkBufferCopy region = {};
+			region.srcOffset = op.src_offset;
+			region.dstOffset = op.dst_offset;
+			region.size = op.size;
+
+			vkCmdCopyBuffer(transfer_cmd, op.src, op.dst_buffer, 1, &region);
+		}
+	}
+
+	if (!split) {
+		// Make the copied data visible to any later vertex, index or shader read on this queue.
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = read_access;
+
+		vkCmdPipelineBarrier(transfer_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, read_stages, 0,
+			1, &barrier,
+			0, nullptr,
+			static_cast<uint32_t>(to_final.size()), to_final.data());
+	}
+	else {
+		// Release on the transfer queue carries only the source access, the
+		// matching acquire on the graphics queue only the destination access.
+		std::vector<VkBufferMemoryBarrier> buffer_release = buffer_handoff;
+		std::vector<VkImageMemoryBarrier> image_release = to_final;
+
+		for (auto& barrier : buffer_release) {
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = 0;
+		}
+		for (auto& barrier : image_release)
+			barrier.dstAccessMask = 0;
+
+		vkCmdPipelineBarrier(transfer_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			static_cast<uint32_t>(buffer_release.size()), buffer_release.data(),
+			static_cast<uint32_t>(image_release.size()), image_release.data());
+
+		for (auto& barrier : buffer_handoff)
+			barrier.dstAccessMask = read_access;
+		for (auto& barrier : to_final)
+			barrier.srcAccessMask = 0;
+
+		vkCmdPipelineBarrier(graphics_cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, read_stages, 0,
+			0, nullptr,
+			static_cast<uint32_t>(buffer_handoff.size()), buffer_handoff.data(),
+			static_cast<uint32_t>(to_final.size()), to_final.data());
+	}
+
+	// Blits need a graphics capable queue, so the mip chains are always built
+	// after the acquire.
+	for (const auto& op : m_pending) {
+		if (op.dst_image != VK_NULL_HANDLE && op.mip_levels > 1)
+			generateMips(graphics_cmd, op);
+	}
+}
+
+void Uploader::generateMips(VkCommandBuffer cmd_buffer, const CopyOp& op)
+{
+	// Levels past 0 were never touched by the transfer queue, so the graphics
+	// queue can take them from UNDEFINED without an ownership transfer.
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = op.dst_image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 1;
+	barrier.subresourceRange.levelCount = op.mip_levels - 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	barrier.subresourceRange.levelCount = 1;
+
+	int32_t width = static_cast<int32_t>(op.extent.width);
+	int32_t height = static_cast<int32_t>(op.extent.height);
+	int32_t depth = static_cast<int32_t>(op.extent.depth);
+
+	for (uint32_t level = 1; level < op.mip_levels; level++) {
+		int32_t next_width = std::max(width / 2, 1);
+		int32_t next_height = std::max(height / 2, 1);
+		int32_t next_depth = std::max(depth / 2, 1);
+
+		VkImageBlit blit = {};
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = level - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { width, height, depth };
+		blit.dstSubresource = blit.srcSubresource;
+		blit.dstSubresource.mipLevel = level;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { next_width, next_height, next_depth };
+
+		vkCmdBlitImage(cmd_buffer, op.dst_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			op.dst_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		// The source level is finished, the level just written becomes the next source.
+		VkImageMemoryBarrier level_barriers[2] = { barrier, barrier };
+		level_barriers[0].subresourceRange.baseMipLevel = level - 1;
+		level_barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		level_barriers[0].newLayout = op.final_layout;
+		level_barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		level_barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		level_barriers[1].subresourceRange.baseMipLevel = level;
+		level_barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		level_barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		level_barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		level_barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			2, level_barriers);
+
+		width = next_width;
+		height = next_height;
+		depth = next_depth;
+	}
+
+	barrier.subresourceRange.baseMipLevel = op.mip_levels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout = op.final_layout;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+}
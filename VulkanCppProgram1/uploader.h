@@ -0,0 +1,118 @@
+#ifndef __UPLOADER__
+#define __UPLOADER__
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <deque>
+#include <vector>
+
+#include "allocator.h"
+#include "gpuprofiler.h"
+#include "ringbuffer.h"
+
+
+// Queues host-to-device copies through a shared StagingRing. Data is copied
+// into the ring immediately; the GPU copies and the layout transitions
+// around them are recorded into one command buffer and submitted together
+// by flush(). It returns a ticket, the value timeline() reaches once the
+// copies have landed, which later queue submissions wait on without
+// involving the host. Ring space is
+// reclaimed as soon as the submission that read it completes, so streaming
+// assets never allocates staging memory.
+//
+// When the transfer family differs from the graphics family the copies run
+// on the transfer queue and end with queue family release barriers; a small
+// graphics-side command buffer waits on the transfer timeline and performs
+// the matching acquires and final layout transitions.
+//
+// With a profiler every submission is timed as the "upload" region, tagged
+// with its ticket, and the graphics side of a split upload as "upload
+// acquire".
+class Uploader
+{
+public:
+    void init(DeviceAllocator& allocator, VkPhysicalDevice phys_device, VkDevice logical_device,
+        VkQueue graphics_queue, uint32_t graphics_family, VkQueue transfer_queue, uint32_t transfer_family,
+        VkDeviceSize staging_size, GpuProfiler* profiler = nullptr);
+    void destroy();
+
+    void uploadBuffer(VkBuffer dst, const void* data, VkDeviceSize size, VkDeviceSize dst_offset = 0);
+    // Only level 0 is read from data; any further levels are generated on
+    // the graphics queue by blitting down from the level above.
+    void uploadImage(VkImage dst, const void* data, VkDeviceSize size, const std::array<uint32_t, 3>& dims,
+        uint32_t mip_levels = 1, VkImageLayout final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // Uploads one pre-built level, e.g. block-compressed data from a KTX2 file.
+    void uploadImageLevel(VkImage dst, const void* data, VkDeviceSize size, const std::array<uint32_t, 3>& dims,
+        uint32_t level, VkImageLayout final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    uint64_t flush();
+    VkSemaphore timeline() const { return m_timeline; }
+
+private:
+    struct CopyOp
+    {
+        VkBuffer src = VK_NULL_HANDLE;
+        VkDeviceSize src_offset = 0;
+        VkBuffer dst_buffer = VK_NULL_HANDLE;
+        VkImage dst_image = VK_NULL_HANDLE;
+        VkDeviceSize dst_offset = 0;
+        VkDeviceSize size = 0;
+        VkExtent3D extent = {};
+        uint32_t level = 0;
+        uint32_t mip_levels = 1;
+        VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    struct TempBuffer
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation alloc;
+    };
+
+    struct Submission
+    {
+        uint64_t ticket = 0;
+        VkCommandBuffer transfer_cmd = VK_NULL_HANDLE;
+        VkCommandBuffer graphics_cmd = VK_NULL_HANDLE;
+        VkDeviceSize staging_end = 0;
+        std::vector<TempBuffer> temp_buffers;
+    };
+
+    void stage(const void* data, VkDeviceSize size, VkDeviceSize alignment, VkBuffer& buffer, VkDeviceSize& offset);
+    void collect(uint64_t wait_ticket);
+    void retire(Submission& submission);
+    void record(VkCommandBuffer transfer_cmd, VkCommandBuffer graphics_cmd);
+    void generateMips(VkCommandBuffer cmd_buffer, const CopyOp& op);
+    VkCommandBuffer acquireCommandBuffer(VkCommandPool pool, std::vector<VkCommandBuffer>& free_list);
+    bool splitQueues() const { return m_transfer_family != m_graphics_family; }
+
+    DeviceAllocator* m_allocator = nullptr;
+    VkDevice m_logical_device = VK_NULL_HANDLE;
+    VkQueue m_graphics_queue = VK_NULL_HANDLE;
+    VkQueue m_transfer_queue = VK_NULL_HANDLE;
+    uint32_t m_graphics_family = 0;
+    uint32_t m_transfer_family = 0;
+    VkCommandPool m_graphics_pool = VK_NULL_HANDLE;
+    VkCommandPool m_transfer_pool = VK_NULL_HANDLE;
+    VkDeviceSize m_image_alignment = 16;
+    GpuProfiler* m_profiler = nullptr;
+    GpuProfiler::RegionId m_copy_region = 0;
+    GpuProfiler::RegionId m_acquire_region = 0;
+    // Reaches a ticket once its copies are visible to the graphics queue.
+    VkSemaphore m_timeline = VK_NULL_HANDLE;
+    // Only used when the queues are split, signalled by the transfer side.
+    VkSemaphore m_transfer_timeline = VK_NULL_HANDLE;
+
+    StagingRing m_staging;
+    std::vector<CopyOp> m_pending;
+    std::vector<TempBuffer> m_pending_temp;
+    std::deque<Submission> m_in_flight;
+    std::vector<VkCommandBuffer> m_free_transfer_cmds;
+    std::vector<VkCommandBuffer> m_free_graphics_cmds;
+    uint64_t m_next_ticket = 1;
+    uint64_t m_completed_ticket = 0;
+};
+
+
+#endif // __UPLOADER__
@@ -1,4 +1,6 @@
 #include "vulkanprog.h"
+#include "ktx2.h"
+#include "taskgraph.h"
 
 #define GLFW_INCLUDE_VULKAN
 #include "GLFW/glfw3.h"
@@ -10,15 +12,20 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include <algorithm>
 #include <array>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <optional>
 #include <set>
 #include <stdexcept>
+#include <thread>
 
 #ifdef NDEBUG
 bool enable_validation_layer = false;
@@ -31,6 +38,8 @@ struct QueueFamilyIndices
 {
 	std::optional<uint32_t> graphics_family;
 	std::optional<uint32_t> present_family;
+	// Family without graphics support used for uploads, if the device has one.
+	std::optional<uint32_t> transfer_family;
 
 	bool isComplete()
 	{
@@ -39,6 +48,20 @@ struct QueueFamilyIndices
 };
 
 
+// Written in front of the driver's cache blob. The driver validates its own
+// header too, but not the driver version, and a stale blob is cheaper to
+// drop here than to hand over.
+struct PipelineCacheFileHeader
+{
+	char magic[4];
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint32_t driver_version;
+	uint8_t uuid[VK_UUID_SIZE];
+	uint64_t data_size;
+};
+
+
 struct SwapChainSupportDetails
 {
 	VkSurfaceCapabilitiesKHR surface_capabilities;
@@ -107,254 +130,113 @@ const std::vector<uint16_t> g_indices = {
 };
 
 
-static std::vector<char> read_shader(const std::string& path)
+// Lays the objects out on a square grid in the z = 0 plane. A single object
+// sits at the origin at full size.
+static glm::mat4 objectModel(uint32_t index, uint32_t count, float time)
 {
-	std::ifstream fp(path, std::ios::ate | std::ios::binary);
-
-	if (!fp.is_open())
-		throw std::runtime_error("Failed to open shader file.");
+	uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(count))));
+	float cell = 2.0f / side;
 
-	size_t size = (size_t)fp.tellg();
-	std::vector<char> buffer(size);
+	glm::vec3 position((index % side + 0.5f) * cell - 1.0f, (index / side + 0.5f) * cell - 1.0f, 0.0f);
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+	model = glm::scale(model, glm::vec3(1.0f / side));
 
-	fp.seekg(0);
-	fp.read(buffer.data(), size);
-	fp.close();
-
-	return buffer;
+	return glm::rotate(model, time * glm::radians(15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 }
 
 
-static void framebufferResizeCb(GLFWwindow* window, int width, int height)
-{
-	auto app = reinterpret_cast<VulkanProg*>(glfwGetWindowUserPointer(window));
-	app->setFramebufferResized(true);
-}
+// Pre-compressed variants of the texture, in order of preference.
+static const char* const COMPRESSED_TEXTURES[] = {
+	"textures/texture.bc.ktx2",
+	"textures/texture.astc.ktx2",
+	"textures/texture.etc2.ktx2"
+};
 
 
-bool checkDeviceExtensionSupport(VkPhysicalDevice device)
+static bool compressedTextureExists(const AssetPack& assets)
 {
-	uint32_t extension_count = 0;
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
-
-	std::vector<VkExtensionProperties> available_extensions(extension_count);
-	vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
-
-	std::set<std::string> required_extentions(device_extensions.begin(), device_extensions.end());
-	for (const auto& extension : available_extensions)
-		required_extentions.erase(extension.extensionName);
+	for (const char* path : COMPRESSED_TEXTURES) {
+		const char* data;
+		size_t size;
+		if (assets.find(path, data, size) || std::ifstream(path).is_open())
+			return true;
+	}
 
-	return required_extentions.empty();
+	return false;
 }
 
 
-VkCommandBuffer beginSingleTimeCommands(VkDevice logical_device, VkCommandPool cmd_pool)
+static double nowMs()
 {
-	VkCommandBufferAllocateInfo alloc_info = {};
-	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	alloc_info.commandPool = cmd_pool;
-	alloc_info.commandBufferCount = 1;
-
-	VkCommandBuffer cmd_buffer;
-	vkAllocateCommandBuffers(logical_device, &alloc_info, &cmd_buffer);
-
-	VkCommandBufferBeginInfo begin_info = {};
-	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-	vkBeginCommandBuffer(cmd_buffer, &begin_info);
-
-	return cmd_buffer;
+	using clock = std::chrono::steady_clock;
+	return std::chrono::duration<double, std::milli>(clock::now().time_since_epoch()).count();
 }
 
 
-void endSingleTimeCommands(VkDevice logical_device, VkCommandPool cmd_pool, VkQueue queue, VkCommandBuffer cmd_buffer)
+static void framebufferResizeCb(GLFWwindow* window, int width, int height)
 {
-	vkEndCommandBuffer(cmd_buffer);
-	VkSubmitInfo submit_info = {};
-	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &cmd_buffer;
-
-	vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queue);
-
-	vkFreeCommandBuffers(logical_device, cmd_pool, 1, &cmd_buffer);
+	auto app = reinterpret_cast<VulkanProg*>(glfwGetWindowUserPointer(window));
+	app->setFramebufferResized(true);
 }
 
 
-void copyBuffer(VkDevice logical_device, VkCommandPool cmd_pool, VkQueue queue, VkBuffer src, VkBuffer dst, VkDeviceSize size)
+static void keyCb(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/)
 {
-	VkCommandBuffer cmd_buffer = beginSingleTimeCommands(logical_device, cmd_pool);
-
-	VkBufferCopy copy_region = {};
-	copy_region.srcOffset = 0;
-	copy_region.dstOffset = 0;
-	copy_region.size = size;
-	vkCmdCopyBuffer(cmd_buffer, src, dst, 1, &copy_region);
-
-	endSingleTimeCommands(logical_device, cmd_pool, queue, cmd_buffer);
-}
-
+	if (action != GLFW_PRESS)
+		return;
 
-void transitionImageLayout(VkDevice logical_device, VkCommandPool cmd_pool, VkQueue queue, VkImage image, VkFormat format,
-	VkImageLayout old_layout, VkImageLayout new_layout)
-{
-	VkCommandBuffer cmd_buffer = beginSingleTimeCommands(logical_device, cmd_pool);
-
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = old_layout;
-	barrier.newLayout = new_layout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.srcAccessMask = 0; // TODO
-	barrier.dstAccessMask = 0; // TODO
-
-	VkPipelineStageFlags src_stage;
-	VkPipelineStageFlags dst_stage;
-
-	if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	}
-	else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
-	else {
-		throw std::invalid_argument("Invalid layout transition.");
+	auto app = reinterpret_cast<VulkanProg*>(glfwGetWindowUserPointer(window));
+	switch (key) {
+	case GLFW_KEY_F1:
+		app->setPresentPolicy(PresentPolicy::LowestLatency);
+		break;
+	case GLFW_KEY_F2:
+		app->setPresentPolicy(PresentPolicy::VSync);
+		break;
+	case GLFW_KEY_F3:
+		app->setPresentPolicy(PresentPolicy::LowPower);
+		break;
+	case GLFW_KEY_F4:
+		app->setPresentPolicy(PresentPolicy::TearFreeLowLatency);
+		break;
 	}
-
-	vkCmdPipelineBarrier(cmd_buffer, src_stage, dst_stage, 0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier);
-
-	endSingleTimeCommands(logical_device, cmd_pool, queue, cmd_buffer);
-}
-
-
-void copyBufferToImage(VkDevice logical_device, VkCommandPool cmd_pool, VkQueue queue,
-	VkBuffer buffer, VkImage image, std::array<uint32_t, 3> dims)
-{
-	VkCommandBuffer cmd_buffer = beginSingleTimeCommands(logical_device, cmd_pool);
-
-	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-	region.imageSubresource.mipLevel = 0;
-
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = { dims[0], dims[1], dims[2] };
-
-	vkCmdCopyBufferToImage(cmd_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-	endSingleTimeCommands(logical_device, cmd_pool, queue, cmd_buffer);
 }
 
 
-static uint32_t findMemoryType(VkPhysicalDevice device, uint32_t type_filter, VkMemoryPropertyFlags properties)
+static const char* presentModeName(VkPresentModeKHR mode)
 {
-	VkPhysicalDeviceMemoryProperties mem_props;
-	vkGetPhysicalDeviceMemoryProperties(device, &mem_props);
-
-	for (uint32_t i = 0; i < mem_props.memoryTypeCount; ++i)
-		if ((type_filter & (1 << i)) && (mem_props.memoryTypes[i].propertyFlags & properties) == properties)
-			return i;
-
-	throw std::runtime_error("Failed to find suitable memory type.");
+	switch (mode) {
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "immediate";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "mailbox";
+	case VK_PRESENT_MODE_FIFO_KHR:
+		return "fifo";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		return "fifo relaxed";
+	default:
+		return "unknown";
+	}
 }
 
 
-void createBuffer(VkPhysicalDevice phys_device, VkDevice logical_device, VkDeviceSize size,
-	VkBufferUsageFlags usage_flags, VkMemoryPropertyFlags prop_flags, VkBuffer & buffer,
-	VkDeviceMemory & buffer_memory)
+bool checkDeviceExtensionSupport(VkPhysicalDevice device, const std::vector<const char*>& extensions)
 {
-	VkBufferCreateInfo buffer_info = {};
-	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	buffer_info.size = size;
-	buffer_info.usage = usage_flags;
-	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	if (vkCreateBuffer(logical_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create buffer.");
-
-	VkMemoryRequirements mem_requirements;
-	vkGetBufferMemoryRequirements(logical_device, buffer, &mem_requirements);
-
-	VkMemoryAllocateInfo alloc_info = {};
-	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	alloc_info.allocationSize = mem_requirements.size;
-	alloc_info.memoryTypeIndex = findMemoryType(phys_device, mem_requirements.memoryTypeBits, prop_flags);
-
-	if (vkAllocateMemory(logical_device, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS)
-		throw std::runtime_error("Failed to allocate buffer memory.");
+	uint32_t extension_count = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
 
-	vkBindBufferMemory(logical_device, buffer, buffer_memory, 0);
-}
+	std::vector<VkExtensionProperties> available_extensions(extension_count);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
 
+	std::set<std::string> required_extentions(extensions.begin(), extensions.end());
+	for (const auto& extension : available_extensions)
+		required_extentions.erase(extension.extensionName);
 
-void createImage(VkPhysicalDevice phys_device, VkDevice logical_device, std::array<uint32_t, 3>& img_dims, VkFormat format,
-	 VkImageTiling tiling, VkImageUsageFlags usage,	VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& image_memory)
-{
-	VkImageCreateInfo img_info = {};
-	img_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	img_info.extent.width = img_dims[0];
-	img_info.extent.height = img_dims[1];
-	img_info.extent.depth = img_dims[2];
-	img_info.mipLevels = 1;
-	img_info.arrayLayers = 1;
-	img_info.format = format;
-	img_info.tiling = tiling;
-	img_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	img_info.usage = usage;
-	img_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	img_info.samples = VK_SAMPLE_COUNT_1_BIT;
-	img_info.flags = 0;
-
-	if (img_dims[1] == 1 && img_dims[2] == 1)
-		img_info.imageType = VK_IMAGE_TYPE_1D;
-	else if (img_dims[2] == 1)
-		img_info.imageType = VK_IMAGE_TYPE_2D;
-	else
-		img_info.imageType = VK_IMAGE_TYPE_3D;
-
-	if (vkCreateImage(logical_device, &img_info, nullptr, &image) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create image.");
-
-	VkMemoryRequirements mem_requirements;
-	vkGetImageMemoryRequirements(logical_device, image, &mem_requirements);
-
-	VkMemoryAllocateInfo alloc_info = {};
-	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	alloc_info.allocationSize = mem_requirements.size;
-	alloc_info.memoryTypeIndex = findMemoryType(phys_device, mem_requirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(logical_device, &alloc_info, nullptr, &image_memory) != VK_SUCCESS)
-		throw std::runtime_error("Failed to allocate image memory.");
-
-	vkBindImageMemory(logical_device, image, image_memory, 0);
+	return required_extentions.empty();
 }
 
 
-VkImageView createImageView(VkDevice logical_device, VkImage image, VkFormat format)
+VkImageView createImageView(VkDevice logical_device, VkImage image, VkFormat format, uint32_t mip_levels = 1)
 {
 	VkImageViewCreateInfo view_info = {};
 	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -363,7 +245,7 @@ VkImageView createImageView(VkDevice logical_device, VkImage image, VkFormat for
 	view_info.format = format;
 	view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	view_info.subresourceRange.baseMipLevel = 0;
-	view_info.subresourceRange.levelCount = 1;
+	view_info.subresourceRange.levelCount = mip_levels;
 	view_info.subresourceRange.baseArrayLayer = 0;
 	view_info.subresourceRange.layerCount = 1;
 
@@ -424,16 +306,90 @@ VkResult destroyDebugUtilsMessengerEXT(
 // Class methods below.
 void VulkanProg::initVulkan()
 {
+	PROFILE_FUNCTION();
+	m_init_start_ms = nowMs();
+
 	if (enable_validation_layer && !checkValidationlayerSupport())
 		throw std::runtime_error("Required validation layers not found.");
 
+	// This thread runs jobs too, one core is left to the driver and the OS.
+	m_jobs.init(std::max(std::thread::hardware_concurrency(), 2u) - 2);
+
+	// Optional, every asset is also looked up as a loose file. A broken
+	// pack is treated like a missing one.
+	try {
+		m_assets.open("assets.pack");
+	}
+	catch (const std::runtime_error& e) {
+		std::cerr << "assets.pack: " << e.what() << " Using loose files." << std::endl;
+	}
+
+	// Each step waits only for the objects it uses. Shader loading and
+	// texture decoding need no device and overlap instance and device
+	// creation, the swapchain and pipeline overlap the texture upload. Steps
+	// that queue uploads are chained, the uploader isn't thread safe.
+	TaskGraph graph;
+	auto instance = graph.add("instance", {}, [this]() { createInstance(); });
+	auto device = graph.add("device", { instance }, [this]() {
+		pickPhysicalDevice();
+		createLogicalDevice();
+	});
+	auto shaders = graph.add("load shaders", {}, [this]() { loadShaders(); });
+	auto decode = graph.add("decode texture", {}, [this]() {
+		if (!compressedTextureExists(m_assets))
+			decodeTexture();
+	});
+	auto swapchain = graph.add("swapchain", { device }, [this]() {
+		if (m_options.headless)
+			createOffscreenTargets();
+		else
+			createSwapChain();
+		createImageViews();
+	});
+	auto render_pass = graph.add("render pass", { swapchain }, [this]() { createRenderPass(); });
+	auto layout = graph.add("descriptor set layout", { device }, [this]() { createDescriptorSetLayout(); });
+	graph.add("graphics pipeline", { render_pass, layout, shaders }, [this]() { createGraphicsPipeline(); });
+	graph.add("framebuffers", { render_pass }, [this]() { createFramebuffers(); });
+	graph.add("command buffers", { device }, [this]() {
+		createCommandPool();
+		createCommandBuffers();
+	});
+	auto texture = graph.add("texture", { device, decode }, [this]() {
+		createTextureImage();
+		m_texture_image_view = createImageView(m_logical_device, m_texture_image, m_texture_format, m_texture_mip_levels);
+		createTextureSampler();
+	});
+	graph.add("mesh upload", { texture }, [this]() {
+		createVertexBuffer();
+		createIndexBuffer();
+
+		// Texture and mesh data go to the GPU in a single submission. The
+		// first frames wait for it on the GPU, the host never blocks on it.
+		m_upload_ticket = m_uploader.flush();
+	});
+	auto uniforms = graph.add("uniform buffer", { device }, [this]() { createUniformBuffer(); });
+	graph.add("descriptor sets", { layout, texture, uniforms }, [this]() {
+		createDescriptorPool();
+		createDescriptorSets();
+	});
+	graph.add("sync objects", { device }, [this]() { createSyncObjects(); });
+
+	graph.run(m_jobs);
+
+	std::cout << "initVulkan on " << m_jobs.threadCount() << " threads:" << std::endl;
+	graph.log(std::cout);
+}
+
+void VulkanProg::createInstance()
+{
+	PROFILE_FUNCTION();
 	VkApplicationInfo app_info = {};
 	app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
 	app_info.pApplicationName = "Basic triangle";
 	app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	app_info.pEngineName = "No engine";
 	app_info.apiVersion = VK_MAKE_VERSION(1, 0, 0);
-	app_info.apiVersion = VK_API_VERSION_1_0;
+	app_info.apiVersion = VK_API_VERSION_1_2;
 
 	auto req_extensions = getRequiredExtensions();
 
@@ -456,28 +412,18 @@ void VulkanProg::initVulkan()
 
 	setupDebugCb();
 
-	if (glfwCreateWindowSurface(m_instance, m_window, nullptr, &m_surface) != VK_SUCCESS)
+	if (!m_options.headless && glfwCreateWindowSurface(m_instance, m_window, nullptr, &m_surface) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create window surface.");
+}
 
-	pickPhysicalDevice();
-	createLogicalDevice();
-	createSwapChain();
-	createImageViews();
-	createRenderPass();
-	createDescriptorSetLayout();
-	createGraphicsPipeline();
-	createFramebuffers();
-	createCommandPool();
-	createTextureImage();
-	m_texture_image_view = createImageView(m_logical_device, m_texture_image, VK_FORMAT_R8G8B8A8_UNORM);
-	createTextureSampler();
-	createVertexBuffer();
-	createIndexBuffer();
-	createUniformBuffer();
-	createDescriptorPool();
-	createDescriptorSets();
-	createCommandBuffers();
-	createSyncObjects();
+void VulkanProg::loadShaders()
+{
+	PROFILE_FUNCTION();
+	// SPIR-V is handed to the driver straight from the pack mapping when the
+	// shaders are packed, loose files are only read as a fallback. Missing
+	// files are reported by createGraphicsPipeline().
+	m_assets.load("shaders/vert.spv", m_vert_code);
+	m_assets.load("shaders/frag.spv", m_frag_code);
 }
 
 void VulkanProg::initWindow()
@@ -488,59 +434,126 @@ void VulkanProg::initWindow()
 	m_window = glfwCreateWindow(WIDTH, HEIGHT, "Basic triangle with Vulkan", nullptr, nullptr);
 	glfwSetWindowUserPointer(m_window, this);
 	glfwSetFramebufferSizeCallback(m_window, framebufferResizeCb);
+	glfwSetKeyCallback(m_window, keyCb);
+
+	// GLFW only answers on the main thread, the swapchain may be created on
+	// another one.
+	int width, height;
+	glfwGetFramebufferSize(m_window, &width, &height);
+	m_framebuffer_extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 }
 
 void VulkanProg::mainLoop()
 {
-	while (!glfwWindowShouldClose(m_window)) {
-		glfwPollEvents();
+	if (m_options.bench_frames > 0)
+		m_bench.init(m_options.bench_warmup, m_options.bench_frames);
+
+	const double start = nowMs();
+
+	while (m_options.headless || !glfwWindowShouldClose(m_window)) {
+		if (m_options.frame_count > 0 && m_frame_number >= m_options.frame_count)
+			break;
+
+		if (!m_options.headless)
+			glfwPollEvents();
 		drawFrame();
 	}
 
 	vkDeviceWaitIdle(m_logical_device);
+	const double end = nowMs();
+
+	if (m_options.frame_count > 0) {
+		const double elapsed = end - start;
+		std::cout << "Rendered " << m_frame_number << " frames in " << elapsed << " ms ("
+			<< m_frame_number * 1000.0 / elapsed << " fps)" << std::endl;
+	}
+
+	// The last frames' timestamps are only readable now.
+	collectGpuTimes();
+
+	for (const auto& region : m_gpu_profiler.regions()) {
+		if (region.samples > 0)
+			std::cout << "GPU " << region.name << ": " << region.averageMs() << " ms average, "
+				<< region.maxMs() << " ms max (last " << region.history.size() << " samples)" << std::endl;
+	}
+
+	if (m_bench.active()) {
+		m_bench.finish(end);
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(m_device, &properties);
+
+		Benchmark::Context context;
+		context.device = properties.deviceName;
+		context.present_mode = m_options.headless ? "offscreen" : presentModeName(m_present_mode);
+		context.frames_in_flight = m_pacer.framesInFlight();
+		context.depth_changes = m_pacer.metrics().depth_changes;
+		context.object_count = m_options.object_count;
+		context.headless = m_options.headless;
+
+		m_bench.writeJson(m_options.bench_output.c_str(), context);
+		std::cout << "Benchmark written to " << m_options.bench_output << std::endl;
+	}
 }
 
 void VulkanProg::cleanup()
 {
+	PROFILE_FUNCTION();
+	// Every job was waited for, nothing below runs any.
+	m_jobs.destroy();
+
+	m_deletion_queue.flush();
 	cleanupSwapChain();
 
+	vkDestroyPipeline(m_logical_device, m_graphics_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_logical_device, m_pipeline_layout, nullptr);
+	vkDestroyRenderPass(m_logical_device, m_renderpass, nullptr);
+
 	vkDestroySampler(m_logical_device, m_texture_sampler, nullptr);
 	vkDestroyImageView(m_logical_device, m_texture_image_view, nullptr);
 
 	vkDestroyImage(m_logical_device, m_texture_image, nullptr);
-	vkFreeMemory(m_logical_device, m_texture_image_memory, nullptr);
+	m_allocator.free(m_texture_image_alloc);
 
 	vkDestroyDescriptorPool(m_logical_device, m_descriptor_pool, nullptr);
 	vkDestroyDescriptorSetLayout(m_logical_device, m_descriptor_set_layout, nullptr);
 
-	for (size_t i = 0; i < m_swapchain_images.size(); ++i) {
-		vkDestroyBuffer(m_logical_device, m_uniform_buffers[i], nullptr);
-		vkFreeMemory(m_logical_device, m_uniform_buffer_memories[i], nullptr);
-	}
+	m_uniform_ring.destroy(m_allocator, m_logical_device);
 
 	vkDestroyBuffer(m_logical_device, m_index_buffer, nullptr);
-	vkFreeMemory(m_logical_device, m_index_buffer_memory, nullptr);
+	m_allocator.free(m_index_buffer_alloc);
 
 	vkDestroyBuffer(m_logical_device, m_vertex_buffer, nullptr);
-	vkFreeMemory(m_logical_device, m_vertex_buffer_memory, nullptr);
+	m_allocator.free(m_vertex_buffer_alloc);
 
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-		vkDestroySemaphore(m_logical_device, m_image_available_semaphores[i], nullptr);
-		vkDestroySemaphore(m_logical_device, m_render_finished_semaphores[i], nullptr);
-		vkDestroyFence(m_logical_device, m_inflight_fences[i], nullptr);
-	}
+	for (auto semaphore : m_image_available_semaphores)
+		vkDestroySemaphore(m_logical_device, semaphore, nullptr);
+	vkDestroySemaphore(m_logical_device, m_frame_timeline, nullptr);
 
-	vkDestroyCommandPool(m_logical_device, m_command_pool, nullptr);
+	savePipelineCache();
+	vkDestroyPipelineCache(m_logical_device, m_pipeline_cache, nullptr);
+
+	m_recorder.destroy();
+	for (auto pool : m_command_pools)
+		vkDestroyCommandPool(m_logical_device, pool, nullptr);
+	m_uploader.destroy();
+	m_gpu_profiler.destroy();
+	m_allocator.destroy();
 	vkDestroyDevice(m_logical_device, nullptr);
 
 	if (enable_validation_layer)
 		destroyDebugUtilsMessengerEXT(m_instance, m_debug_messenger, nullptr);
 
-	vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+	if (m_surface != VK_NULL_HANDLE)
+		vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
 	vkDestroyInstance(m_instance, nullptr);
 
-	glfwDestroyWindow(m_window);
-	glfwTerminate();
+	m_assets.close();
+
+	if (m_window) {
+		glfwDestroyWindow(m_window);
+		glfwTerminate();
+	}
 }
 
 bool VulkanProg::checkValidationlayerSupport()
@@ -570,16 +583,27 @@ bool VulkanProg::checkValidationlayerSupport()
 
 std::vector<const char*> VulkanProg::getRequiredExtensions()
 {
-	uint32_t glfw_ext_count = 0;
-	const char** glfw_ext = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+	std::vector<const char*> extensions;
+	if (!m_options.headless) {
+		uint32_t glfw_ext_count = 0;
+		const char** glfw_ext = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+		extensions.assign(glfw_ext, glfw_ext + glfw_ext_count);
+	}
 
-	std::vector<const char*> extensions(glfw_ext, glfw_ext + glfw_ext_count);
 	if (enable_validation_layer)
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 
 	return extensions;
 }
 
+std::vector<const char*> VulkanProg::requiredDeviceExtensions()
+{
+	if (m_options.headless)
+		return {};
+
+	return device_extensions;
+}
+
 void VulkanProg::setupDebugCb()
 {
 	if (!enable_validation_layer)
@@ -598,6 +622,7 @@ void VulkanProg::setupDebugCb()
 
 void VulkanProg::pickPhysicalDevice()
 {
+	PROFILE_FUNCTION();
 	uint32_t count = 0;
 	vkEnumeratePhysicalDevices(m_instance, &count, nullptr);
 
@@ -620,10 +645,12 @@ void VulkanProg::pickPhysicalDevice()
 
 void VulkanProg::createLogicalDevice()
 {
+	PROFILE_FUNCTION();
 	QueueFamilyIndices indices = findQueueFamilies(m_device);
 
 	std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
-	std::set<uint32_t> unique_queue_families = { indices.graphics_family.value(), indices.present_family.value() };
+	uint32_t transfer_family = indices.transfer_family.value_or(indices.graphics_family.value());
+	std::set<uint32_t> unique_queue_families = { indices.graphics_family.value(), indices.present_family.value(), transfer_family };
 
 	float queue_priority = 1.f;
 	for (uint32_t queue_family : unique_queue_families) {
@@ -635,16 +662,42 @@ void VulkanProg::createLogicalDevice()
 		queue_create_infos.push_back(queue_create_info);
 	}
 
+	VkPhysicalDeviceFeatures supported_features;
+	vkGetPhysicalDeviceFeatures(m_device, &supported_features);
+
+	// Enable every block compression family the device has so the texture
+	// loader can pick whichever pre-compressed variant fits.
 	VkPhysicalDeviceFeatures dev_features = {};
 	dev_features.samplerAnisotropy = VK_TRUE;
+	dev_features.textureCompressionBC = supported_features.textureCompressionBC;
+	dev_features.textureCompressionETC2 = supported_features.textureCompressionETC2;
+	dev_features.textureCompressionASTC_LDR = supported_features.textureCompressionASTC_LDR;
+	m_device_features = dev_features;
+
+	VkPhysicalDeviceVulkan12Features supported_vk12_features = {};
+	supported_vk12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+
+	VkPhysicalDeviceFeatures2 features2 = {};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &supported_vk12_features;
+	vkGetPhysicalDeviceFeatures2(m_device, &features2);
+
+	// Host query reset is only needed by the GPU profiler, which turns
+	// itself off without it.
+	VkPhysicalDeviceVulkan12Features vk12_features = {};
+	vk12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+	vk12_features.timelineSemaphore = VK_TRUE;
+	vk12_features.hostQueryReset = supported_vk12_features.hostQueryReset;
 
 	VkDeviceCreateInfo device_create_info = {};
 	device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	device_create_info.pNext = &vk12_features;
 	device_create_info.pQueueCreateInfos = queue_create_infos.data();
 	device_create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
 	device_create_info.pEnabledFeatures = &dev_features;
-	device_create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
-	device_create_info.ppEnabledExtensionNames = device_extensions.data();
+	const std::vector<const char*> extensions = requiredDeviceExtensions();
+	device_create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	device_create_info.ppEnabledExtensionNames = extensions.data();
 
 	if (enable_validation_layer) {
 		device_create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
@@ -657,19 +710,128 @@ void VulkanProg::createLogicalDevice()
 	if (vkCreateDevice(m_device, &device_create_info, nullptr, &m_logical_device) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create logical device.");
 
-	vkGetDeviceQueue(m_logical_device, indices.graphics_family.value(), 0, &m_graphics_queue);
+	m_graphics_family = indices.graphics_family.value();
+	vkGetDeviceQueue(m_logical_device, m_graphics_family, 0, &m_graphics_queue);
 	vkGetDeviceQueue(m_logical_device, indices.present_family.value(), 0, &m_presentation_queue);
+	vkGetDeviceQueue(m_logical_device, transfer_family, 0, &m_transfer_queue);
+
+	createPipelineCache();
+
+	m_gpu_profiler.init(m_device, m_logical_device, vk12_features.hostQueryReset, GPU_PROFILER_SCOPES);
+	m_frame_region = m_gpu_profiler.region("frame");
+	if (!m_gpu_profiler.enabled())
+		std::cerr << "GPU profiler disabled, it needs hostQueryReset and timestamp queries. GPU times are not measured." << std::endl;
+
+	m_allocator.init(m_device, m_logical_device);
+	m_uploader.init(m_allocator, m_device, m_logical_device, m_graphics_queue, indices.graphics_family.value(),
+		m_transfer_queue, transfer_family, STAGING_BUFFER_SIZE, &m_gpu_profiler);
+}
+
+void VulkanProg::createPipelineCache()
+{
+	PROFILE_FUNCTION();
+	VkPhysicalDeviceProperties dev_props;
+	vkGetPhysicalDeviceProperties(m_device, &dev_props);
+
+	std::vector<char> data;
+	std::ifstream fp(PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary);
+
+	if (fp.is_open()) {
+		size_t size = (size_t)fp.tellg();
+		PipelineCacheFileHeader header;
+
+		if (size >= sizeof(header)) {
+			fp.seekg(0);
+			fp.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+			bool valid = memcmp(header.magic, "VKPC", 4) == 0 &&
+				header.vendor_id == dev_props.vendorID &&
+				header.device_id == dev_props.deviceID &&
+				header.driver_version == dev_props.driverVersion &&
+				memcmp(header.uuid, dev_props.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+				header.data_size == size - sizeof(header);
+
+			if (valid) {
+				data.resize(static_cast<size_t>(header.data_size));
+				fp.read(data.data(), data.size());
+			}
+		}
+
+		fp.close();
+	}
+
+	VkPipelineCacheCreateInfo cache_info = {};
+	cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cache_info.initialDataSize = data.size();
+	cache_info.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(m_logical_device, &cache_info, nullptr, &m_pipeline_cache) == VK_SUCCESS)
+		return;
+
+	// A blob the driver still rejects is dropped, start from an empty cache.
+	cache_info.initialDataSize = 0;
+	cache_info.pInitialData = nullptr;
+
+	if (vkCreatePipelineCache(m_logical_device, &cache_info, nullptr, &m_pipeline_cache) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create pipeline cache.");
+}
+
+void VulkanProg::savePipelineCache()
+{
+	PROFILE_FUNCTION();
+	size_t size = 0;
+	if (vkGetPipelineCacheData(m_logical_device, m_pipeline_cache, &size, nullptr) != VK_SUCCESS || size == 0)
+		return;
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(m_logical_device, m_pipeline_cache, &size, data.data()) != VK_SUCCESS)
+		return;
+
+	VkPhysicalDeviceProperties dev_props;
+	vkGetPhysicalDeviceProperties(m_device, &dev_props);
+
+	PipelineCacheFileHeader header = {};
+	memcpy(header.magic, "VKPC", 4);
+	header.vendor_id = dev_props.vendorID;
+	header.device_id = dev_props.deviceID;
+	header.driver_version = dev_props.driverVersion;
+	memcpy(header.uuid, dev_props.pipelineCacheUUID, VK_UUID_SIZE);
+	header.data_size = size;
+
+	// Write next to the old cache and swap it in, an interrupted run never
+	// leaves a truncated file behind.
+	std::string tmp_path = std::string(PIPELINE_CACHE_PATH) + ".tmp";
+	std::ofstream fp(tmp_path, std::ios::binary | std::ios::trunc);
+
+	if (!fp.is_open()) {
+		std::cerr << "Failed to write pipeline cache." << std::endl;
+		return;
+	}
+
+	fp.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fp.write(data.data(), size);
+	fp.close();
+
+	std::remove(PIPELINE_CACHE_PATH);
+	if (std::rename(tmp_path.c_str(), PIPELINE_CACHE_PATH) != 0)
+		std::cerr << "Failed to write pipeline cache." << std::endl;
 }
 
 void VulkanProg::createSwapChain()
 {
+	PROFILE_FUNCTION();
 	SwapChainSupportDetails swap_chain_support = querySwapChainSupport(m_device);
 
 	VkSurfaceFormatKHR surface_format = chooseSwapSurfaceFormat(swap_chain_support.surface_formats);
 	VkPresentModeKHR present_mode = chooseSwapPresentMode(swap_chain_support.present_modes);
+	if (present_mode != m_present_mode)
+		std::cout << "Present mode: " << presentModeName(present_mode) << std::endl;
+	m_present_mode = present_mode;
 	VkExtent2D extent = chooseSwapExtent(swap_chain_support.surface_capabilities);
 
 	uint32_t img_count = swap_chain_support.surface_capabilities.minImageCount + 1;
+	if (m_options.swapchain_images > 0)
+		img_count = std::max(m_options.swapchain_images, swap_chain_support.surface_capabilities.minImageCount);
 	if (swap_chain_support.surface_capabilities.maxImageCount > 0 && img_count > swap_chain_support.surface_capabilities.maxImageCount)
 		img_count = swap_chain_support.surface_capabilities.maxImageCount;
 
@@ -701,7 +863,9 @@ void VulkanProg::createSwapChain()
 	create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	create_info.presentMode = present_mode;
 	create_info.clipped = VK_TRUE;
-	create_info.oldSwapchain = VK_NULL_HANDLE;
+	// Handing over the current swapchain lets the presentation engine reuse
+	// its resources and keeps the window contents valid during a resize.
+	create_info.oldSwapchain = m_swapchain;
 
 	if (vkCreateSwapchainKHR(m_logical_device, &create_info, nullptr, &m_swapchain) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create swap chain");
@@ -713,10 +877,48 @@ void VulkanProg::createSwapChain()
 	vkGetSwapchainImagesKHR(m_logical_device, m_swapchain, &image_count, nullptr);
 	m_swapchain_images.resize(image_count);
 	vkGetSwapchainImagesKHR(m_logical_device, m_swapchain, &image_count, m_swapchain_images.data());
+
+	// Present waits on the render_finished semaphore of the image it shows.
+	// Keeping one per image means a semaphore is only signalled again after
+	// its image was re-acquired, i.e. after that earlier present waited on it.
+	VkSemaphoreCreateInfo semaphore_info = {};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	m_render_finished_semaphores.resize(image_count);
+	for (auto& semaphore : m_render_finished_semaphores) {
+		if (vkCreateSemaphore(m_logical_device, &semaphore_info, nullptr, &semaphore) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create render_finished semaphore.");
+	}
+
+	m_images_in_flight.assign(image_count, 0);
+}
+
+void VulkanProg::createOffscreenTargets()
+{
+	PROFILE_FUNCTION();
+	// Stand-ins for the swapchain images. Without a presentation engine
+	// holding on to images, one per frame slot keeps every frame in flight
+	// on its own target.
+	uint32_t image_count = m_options.swapchain_images > 0 ? m_options.swapchain_images : m_options.max_frames_in_flight;
+	std::array<uint32_t, 3> dims = { static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT), 1 };
+
+	m_swapchain_format = VK_FORMAT_B8G8R8A8_UNORM;
+	m_swapchain_extent = { dims[0], dims[1] };
+	m_swapchain_images.resize(image_count);
+	m_offscreen_allocs.resize(image_count);
+
+	for (uint32_t i = 0; i < image_count; ++i) {
+		createImage(m_allocator, m_logical_device, dims, m_swapchain_format, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			m_swapchain_images[i], m_offscreen_allocs[i]);
+	}
+
+	m_images_in_flight.assign(image_count, 0);
 }
 
 void VulkanProg::createImageViews()
 {
+	PROFILE_FUNCTION();
 	m_swapchain_image_views.resize(m_swapchain_images.size());
 
 	for (size_t i = 0; i < m_swapchain_images.size(); ++i) {
@@ -744,6 +946,7 @@ void VulkanProg::createImageViews()
 
 void VulkanProg::createRenderPass()
 {
+	PROFILE_FUNCTION();
 	VkAttachmentDescription color_attach = {};
 	color_attach.format = m_swapchain_format;
 	color_attach.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -752,7 +955,9 @@ void VulkanProg::createRenderPass()
 	color_attach.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	color_attach.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	color_attach.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	color_attach.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// PRESENT_SRC needs VK_KHR_swapchain, offscreen targets are left ready
+	// to be copied out.
+	color_attach.finalLayout = m_options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentReference color_attach_ref = {};
 	color_attach_ref.attachment = 0;
@@ -786,41 +991,27 @@ void VulkanProg::createRenderPass()
 
 void VulkanProg::createGraphicsPipeline()
 {
-	std::vector<char> vert_code;
-	try {
-		vert_code = read_shader("shaders/vert.spv");
-	}
-	catch (std::runtime_error e) {
-		std::cerr << e.what() << std::endl;
-		return;
-	}
-
-	std::vector<char> frag_code;
-	try {
-		frag_code = read_shader("shaders/frag.spv");
-	}
-	catch (std::runtime_error e) {
-		std::cerr << e.what() << std::endl;
+	PROFILE_FUNCTION();
+	if (!m_vert_code.data || !m_frag_code.data) {
+		std::cerr << "Failed to open shader file." << std::endl;
 		return;
 	}
 
 	VkShaderModule vert_shader;
 	try {
-		vert_shader = createShaderModule(vert_code);
+		vert_shader = createShaderModule(m_vert_code.data, m_vert_code.size);
 	}
 	catch (std::runtime_error& e) {
 		std::cerr << e.what() << std::endl;
-		vert_code.clear();
 		return;
 	}
 
 	VkShaderModule frag_shader;
 	try {
-		frag_shader = createShaderModule(frag_code);
+		frag_shader = createShaderModule(m_frag_code.data, m_frag_code.size);
 	}
 	catch (std::runtime_error& e) {
 		std::cerr << e.what() << std::endl;
-		frag_code.clear();
 		vkDestroyShaderModule(m_logical_device, vert_shader, nullptr);
 		return;
 	}
@@ -856,26 +1047,21 @@ void VulkanProg::createGraphicsPipeline()
 	vertex_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	vertex_assembly_info.primitiveRestartEnable = VK_FALSE;
 
-	// Viewport definition
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)m_swapchain_extent.width;
-	viewport.height = (float)m_swapchain_extent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = m_swapchain_extent;
-
-	// Viewport state definition
+	// Viewport state definition, the viewport and scissor themselves are set
+	// at record time so the pipeline survives swapchain resizes.
 	VkPipelineViewportStateCreateInfo viewport_info = {};
 	viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewport_info.viewportCount = 1;
-	viewport_info.pViewports = &viewport;
+	viewport_info.pViewports = nullptr;
 	viewport_info.scissorCount = 1;
-	viewport_info.pScissors = &scissor;
+	viewport_info.pScissors = nullptr;
+
+	VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamic_info = {};
+	dynamic_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_info.dynamicStateCount = 2;
+	dynamic_info.pDynamicStates = dynamic_states;
 
 	// Rasterizer state
 	VkPipelineRasterizationStateCreateInfo raster_info = {};
@@ -949,14 +1135,14 @@ void VulkanProg::createGraphicsPipeline()
 	pipeline_info.pMultisampleState = &msample_info;
 	pipeline_info.pDepthStencilState = nullptr;
 	pipeline_info.pColorBlendState = &color_blend_info;
-	pipeline_info.pDynamicState = nullptr;
+	pipeline_info.pDynamicState = &dynamic_info;
 	pipeline_info.layout = m_pipeline_layout;
 	pipeline_info.renderPass = m_renderpass;
 	pipeline_info.subpass = 0;
 	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 	pipeline_info.basePipelineIndex = -1;
 
-	if (vkCreateGraphicsPipelines(m_logical_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &m_graphics_pipeline) != VK_SUCCESS)
+	if (vkCreateGraphicsPipelines(m_logical_device, m_pipeline_cache, 1, &pipeline_info, nullptr, &m_graphics_pipeline) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create graphics pipeline.");
 
 	vkDestroyShaderModule(m_logical_device, vert_shader, nullptr);
@@ -965,6 +1151,7 @@ void VulkanProg::createGraphicsPipeline()
 
 void VulkanProg::createFramebuffers()
 {
+	PROFILE_FUNCTION();
 	m_swapchain_framebuffers.resize(m_swapchain_image_views.size());
 
 	for (size_t i = 0; i < m_swapchain_image_views.size(); ++i) {
@@ -988,237 +1175,482 @@ void VulkanProg::createFramebuffers()
 
 void VulkanProg::createCommandPool()
 {
+	PROFILE_FUNCTION();
 	QueueFamilyIndices indices = findQueueFamilies(m_device);
 
+	// One pool per frame in flight. Each holds only that frame's command
+	// buffer and is reset as a whole before the frame is recorded.
 	VkCommandPoolCreateInfo pool_info = {};
 	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	pool_info.queueFamilyIndex = indices.graphics_family.value();
-	pool_info.flags = 0;
+	pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	m_command_pools.resize(m_options.max_frames_in_flight);
+	for (auto& pool : m_command_pools) {
+		if (vkCreateCommandPool(m_logical_device, &pool_info, nullptr, &pool) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create command pool.");
+	}
 
-	if (vkCreateCommandPool(m_logical_device, &pool_info, nullptr, &m_command_pool) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create command pool.");
+	m_recorder.init(m_logical_device, indices.graphics_family.value(), m_jobs, m_options.max_frames_in_flight);
 }
 
 void VulkanProg::createCommandBuffers()
 {
-	m_command_buffers.resize(m_swapchain_framebuffers.size());
-
-	VkCommandBufferAllocateInfo alloc_info = {};
-	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	alloc_info.commandPool = m_command_pool;
-	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	alloc_info.commandBufferCount = static_cast<uint32_t>(m_command_buffers.size());
-
-	if (vkAllocateCommandBuffers(m_logical_device, &alloc_info, m_command_buffers.data()) != VK_SUCCESS)
-		throw std::runtime_error("Failed to allocate command buffers.");
-
-	for (size_t i = 0; i < m_command_buffers.size(); ++i) {
-		VkCommandBufferBeginInfo begin_info = {};
-		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		begin_info.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		begin_info.pInheritanceInfo = nullptr;
+	PROFILE_FUNCTION();
+	m_command_buffers.resize(m_command_pools.size());
+
+	for (size_t i = 0; i < m_command_pools.size(); ++i) {
+		VkCommandBufferAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.commandPool = m_command_pools[i];
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(m_logical_device, &alloc_info, &m_command_buffers[i]) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate command buffers.");
+	}
+}
 
-		if (vkBeginCommandBuffer(m_command_buffers[i], &begin_info) != VK_SUCCESS)
-			throw std::runtime_error("Failed to begin recording command buffer.");
+void VulkanProg::recordCommandBuffer(VkCommandBuffer cmd_buffer, uint32_t image_index)
+{
+	PROFILE_FUNCTION();
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = nullptr;
+
+	if (vkBeginCommandBuffer(cmd_buffer, &begin_info) != VK_SUCCESS)
+		throw std::runtime_error("Failed to begin recording command buffer.");
+
+	const uint32_t frame = static_cast<uint32_t>(m_current_frame);
+	const uint64_t frame_number = m_frame_number + 1;
+	// Spans the whole command buffer, which is only the render pass.
+	GpuProfiler::Scope frame_scope = m_gpu_profiler.begin(cmd_buffer, m_graphics_family, m_frame_region, frame_number);
+
+	VkRenderPassBeginInfo render_pass_info = {};
+	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	render_pass_info.renderPass = m_renderpass;
+	render_pass_info.framebuffer = m_swapchain_framebuffers[image_index];
+	render_pass_info.renderArea.offset = { 0, 0 };
+	render_pass_info.renderArea.extent = m_swapchain_extent;
+
+	VkClearValue clear_color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	render_pass_info.clearValueCount = 1;
+	render_pass_info.pClearValues = &clear_color;
+
+	// Draws are recorded into secondaries by the worker threads, the primary
+	// only clears and executes them.
+	vkCmdBeginRenderPass(cmd_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	VkCommandBufferInheritanceInfo inheritance = {};
+	inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance.renderPass = m_renderpass;
+	inheritance.subpass = 0;
+	inheritance.framebuffer = m_swapchain_framebuffers[image_index];
+
+	JobSystem::Counter recording;
+	m_recorder.record(frame, inheritance, m_options.object_count,
+		[this, frame](VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+			recordDraws(secondary, frame, first, count);
+		}, recording);
+	{
+		PROFILE_ZONE("wait recording");
+		m_jobs.wait(recording);
+	}
 
-		VkRenderPassBeginInfo render_pass_info = {};
-		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		render_pass_info.renderPass = m_renderpass;
-		render_pass_info.framebuffer = m_swapchain_framebuffers[i];
-		render_pass_info.renderArea.offset = { 0, 0 };
-		render_pass_info.renderArea.extent = m_swapchain_extent;
+	const auto& secondaries = m_recorder.recorded();
+	vkCmdExecuteCommands(cmd_buffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+	vkCmdEndRenderPass(cmd_buffer);
+	m_gpu_profiler.end(cmd_buffer, frame_scope);
 
-		VkClearValue clear_color = { 0.0f, 0.0f, 0.0f, 1.0f };
-		render_pass_info.clearValueCount = 1;
-		render_pass_info.pClearValues = &clear_color;
+	if (vkEndCommandBuffer(cmd_buffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to record command buffer.");
+}
 
-		vkCmdBeginRenderPass(m_command_buffers[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(m_command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics_pipeline);
+void VulkanProg::recordDraws(VkCommandBuffer cmd_buffer, uint32_t frame, uint32_t first, uint32_t count)
+{
+	// Secondaries inherit nothing but the render pass, all state is bound again.
+	vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics_pipeline);
 
-		VkBuffer vertex_buffers[] = { m_vertex_buffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(m_command_buffers[i], 0, 1, vertex_buffers, offsets);
-		vkCmdBindIndexBuffer(m_command_buffers[i], m_index_buffer, 0, VK_INDEX_TYPE_UINT16);
-		vkCmdBindDescriptorSets(m_command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &m_descriptor_sets[i], 0, nullptr);
-		vkCmdDrawIndexed(m_command_buffers[i], static_cast<uint32_t>(g_indices.size()), 1, 0, 0, 0);
-		vkCmdEndRenderPass(m_command_buffers[i]);
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)m_swapchain_extent.width;
+	viewport.height = (float)m_swapchain_extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(cmd_buffer, 0, 1, &viewport);
 
-		if (vkEndCommandBuffer(m_command_buffers[i]) != VK_SUCCESS)
-			throw std::runtime_error("Failed to record command buffer.");
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = m_swapchain_extent;
+	vkCmdSetScissor(cmd_buffer, 0, 1, &scissor);
+
+	VkBuffer vertex_buffers[] = { m_vertex_buffer };
+	VkDeviceSize offsets[] = { 0 };
+	vkCmdBindVertexBuffers(cmd_buffer, 0, 1, vertex_buffers, offsets);
+	vkCmdBindIndexBuffer(cmd_buffer, m_index_buffer, 0, VK_INDEX_TYPE_UINT16);
+
+	// Each object reads its own UniformBufferObject from this frame's ring
+	// slice, the offset only depends on the object index.
+	VkDeviceSize ubo_stride = m_uniform_ring.alignedSize(sizeof(UniformBufferObject));
+	for (uint32_t obj = first; obj < first + count; ++obj) {
+		uint32_t dynamic_offset = static_cast<uint32_t>(m_uniform_ring.sliceOffset(frame) + obj * ubo_stride);
+		vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &m_descriptor_set, 1, &dynamic_offset);
+		vkCmdDrawIndexed(cmd_buffer, static_cast<uint32_t>(g_indices.size()), 1, 0, 0, 0);
 	}
 }
 
 void VulkanProg::createSyncObjects()
 {
-	m_image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	m_render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	m_inflight_fences.resize(MAX_FRAMES_IN_FLIGHT);
+	PROFILE_FUNCTION();
+	m_image_available_semaphores.resize(m_options.headless ? 0 : m_options.max_frames_in_flight);
 
 	VkSemaphoreCreateInfo semaphore_info = {};
 	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fence_info = {};
-	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-		if (vkCreateSemaphore(m_logical_device, &semaphore_info, nullptr, &m_image_available_semaphores[i]) != VK_SUCCESS)
+	// The swapchain only takes binary semaphores, everything else paces
+	// itself on the frame timeline.
+	for (auto& semaphore : m_image_available_semaphores) {
+		if (vkCreateSemaphore(m_logical_device, &semaphore_info, nullptr, &semaphore) != VK_SUCCESS)
 			throw std::runtime_error("Failed to create image_available semaphore.");
-		if (vkCreateSemaphore(m_logical_device, &semaphore_info, nullptr, &m_render_finished_semaphores[i]) != VK_SUCCESS)
-			throw std::runtime_error("Failed to create render_finished semaphore.");
-		if (vkCreateFence(m_logical_device, &fence_info, nullptr, &m_inflight_fences[i]) != VK_SUCCESS)
-			throw std::runtime_error("Failed to create inflight fence.");
 	}
+
+	// Counts completed frames, each submission signals its frame number.
+	VkSemaphoreTypeCreateInfo type_info = {};
+	type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	type_info.initialValue = 0;
+	semaphore_info.pNext = &type_info;
+
+	if (vkCreateSemaphore(m_logical_device, &semaphore_info, nullptr, &m_frame_timeline) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create frame timeline semaphore.");
+	m_frame_number = 0;
+	m_pacer.init(m_options.frames_in_flight, m_options.max_frames_in_flight, m_options.adaptive_frames);
+	m_pacer.pin(m_options.present_policy == PresentPolicy::LowPower ? 1 : 0);
 }
 
-void VulkanProg::drawFrame()
+void VulkanProg::collectGpuTimes()
 {
-	vkWaitForFences(m_logical_device, 1, &m_inflight_fences[m_current_frame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	m_gpu_profiler.collect([this](GpuProfiler::RegionId region, uint64_t frame_number, double ms) {
+		if (region == m_frame_region)
+			m_bench.record(frame_number, Benchmark::Gpu, ms);
+	});
+}
 
-	uint32_t image_idx;
-	VkResult result = vkAcquireNextImageKHR(m_logical_device, m_swapchain, std::numeric_limits<uint64_t>::max(), m_image_available_semaphores[m_current_frame], VK_NULL_HANDLE, &image_idx);
+uint64_t VulkanProg::completedFrame()
+{
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(m_logical_device, m_frame_timeline, &value);
+	return value;
+}
+
+void VulkanProg::waitForFrame(uint64_t frame_number)
+{
+	PROFILE_FUNCTION();
+	VkSemaphoreWaitInfo wait_info = {};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &m_frame_timeline;
+	wait_info.pValues = &frame_number;
+
+	if (vkWaitSemaphores(m_logical_device, &wait_info, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to wait for frame timeline.");
+}
+
+void VulkanProg::drawFrame()
+{
+	PROFILE_FUNCTION();
+	const double frame_start = nowMs();
+	const double frame_ms = m_last_frame_start > 0.0 ? frame_start - m_last_frame_start : 0.0;
+	m_last_frame_start = frame_start;
+
+	// Slots cycle through every allocated frame, but only the current depth
+	// may be in flight. Any depth up to the slot count keeps the frame that
+	// last used this slot at or before the one waited on.
+	const uint64_t frame_number = m_frame_number + 1;
+	const uint32_t depth = m_pacer.framesInFlight();
+	m_current_frame = static_cast<size_t>(frame_number % m_options.max_frames_in_flight);
+	if (frame_number > depth)
+		waitForFrame(frame_number - depth);
+	m_deletion_queue.collect(completedFrame());
+	collectGpuTimes();
+	m_bench.beginFrame(frame_number, frame_start);
+
+	const double cpu_start = nowMs();
+
+	// Offscreen targets are simply taken in turn.
+	uint32_t image_idx = static_cast<uint32_t>(frame_number % m_swapchain_images.size());
+	VkResult result = VK_SUCCESS;
+	if (!m_options.headless) {
+		PROFILE_ZONE("vkAcquireNextImageKHR");
+		result = vkAcquireNextImageKHR(m_logical_device, m_swapchain, std::numeric_limits<uint64_t>::max(), m_image_available_semaphores[m_current_frame], VK_NULL_HANDLE, &image_idx);
+	}
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		rebuildSwapChain();
 		return;
 	}
 	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
 		throw std::runtime_error("Failed to aquire swap chain image");
-
-	updateUniformBuffer(image_idx);
-
-	VkSemaphore wait_semaphores[] = { m_image_available_semaphores[m_current_frame] };
-	VkSemaphore signal_semaphores[] = { m_render_finished_semaphores[m_current_frame] };
-	VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	if (!m_options.headless)
+		m_bench.record(frame_number, Benchmark::Acquire, nowMs() - cpu_start);
+
+	// Images can come back out of order or ahead of the slot rotation. Only
+	// the frame that last rendered this image has to be finished with it,
+	// and usually it already is.
+	const uint64_t image_frame = m_images_in_flight[image_idx];
+	if (image_frame > completedFrame())
+		waitForFrame(image_frame);
+
+	// The frame's pool only holds its own command buffer, resetting the pool
+	// recycles all of its memory at once.
+	vkResetCommandPool(m_logical_device, m_command_pools[m_current_frame], 0);
+
+	// Uniform writes run as jobs while this thread records, it also helps
+	// with them while waiting for the secondaries.
+	const double update_start = nowMs();
+	JobSystem::Counter uniforms;
+	updateUniformBuffer(static_cast<uint32_t>(m_current_frame), uniforms);
+	try {
+		recordCommandBuffer(m_command_buffers[m_current_frame], image_idx);
+	}
+	catch (...) {
+		// The uniform jobs still reference the counter, they have to finish
+		// before it goes out of scope. Their own errors lose to this one.
+		try {
+			m_jobs.wait(uniforms);
+		}
+		catch (...) {
+		}
+		throw;
+	}
+	{
+		PROFILE_ZONE("wait uniforms");
+		m_jobs.wait(uniforms);
+	}
+	m_bench.record(frame_number, Benchmark::Update, nowMs() - update_start);
+
+	// Waiting on an upload that already landed costs nothing, so every frame
+	// names the initial one instead of tracking when it completed. Binary
+	// semaphores ignore their entries in the value arrays. The swapchain
+	// pair comes first and is skipped when headless.
+	const uint32_t first = m_options.headless ? 1 : 0;
+	VkSemaphore wait_semaphores[] = { m_options.headless ? VK_NULL_HANDLE : m_image_available_semaphores[m_current_frame], m_uploader.timeline() };
+	uint64_t wait_values[] = { 0, m_upload_ticket };
+	VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
+	VkSemaphore signal_semaphores[] = { m_options.headless ? VK_NULL_HANDLE : m_render_finished_semaphores[image_idx], m_frame_timeline };
+	uint64_t signal_values[] = { 0, frame_number };
+
+	VkTimelineSemaphoreSubmitInfo timeline_info = {};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.waitSemaphoreValueCount = 2 - first;
+	timeline_info.pWaitSemaphoreValues = wait_values + first;
+	timeline_info.signalSemaphoreValueCount = 2 - first;
+	timeline_info.pSignalSemaphoreValues = signal_values + first;
 
 	VkSubmitInfo submit_info = {};
 	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.waitSemaphoreCount = 1;
-	submit_info.pWaitSemaphores = wait_semaphores;
-	submit_info.pWaitDstStageMask = wait_stages;
+	submit_info.pNext = &timeline_info;
+	submit_info.waitSemaphoreCount = 2 - first;
+	submit_info.pWaitSemaphores = wait_semaphores + first;
+	submit_info.pWaitDstStageMask = wait_stages + first;
 	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &m_command_buffers[image_idx];
-	submit_info.signalSemaphoreCount = 1;
-	submit_info.pSignalSemaphores = signal_semaphores;
+	submit_info.pCommandBuffers = &m_command_buffers[m_current_frame];
+	submit_info.signalSemaphoreCount = 2 - first;
+	submit_info.pSignalSemaphores = signal_semaphores + first;
+
+	const double submit_start = nowMs();
+	{
+		PROFILE_ZONE("vkQueueSubmit");
+		if (vkQueueSubmit(m_graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Failed to submit draw command buffer");
+	}
+	m_bench.record(frame_number, Benchmark::Submit, nowMs() - submit_start);
+	m_frame_number = frame_number;
+	m_images_in_flight[image_idx] = frame_number;
+	if (frame_number == 1)
+		std::cout << "First frame submitted " << nowMs() - m_init_start_ms << " ms after initVulkan started" << std::endl;
+
+	if (m_pacer.endFrame(nowMs() - cpu_start, cpu_start - frame_start, frame_ms)) {
+		const FramePacer::Metrics& metrics = m_pacer.metrics();
+		std::cout << "Frames in flight: " << depth << " -> " << metrics.frames_in_flight
+			<< ", change " << metrics.depth_changes << " (cpu " << metrics.cpu_ms << " ms, max " << metrics.cpu_max_ms
+			<< " ms, wait " << metrics.wait_ms << " ms, frame " << metrics.frame_ms << " ms)" << std::endl;
+	}
 
-	vkResetFences(m_logical_device, 1, &m_inflight_fences[m_current_frame]);
-	if (vkQueueSubmit(m_graphics_queue, 1, &submit_info, m_inflight_fences[m_current_frame]) != VK_SUCCESS)
-		throw std::runtime_error("Failed to submit draw command buffer");
+	if (m_options.headless) {
+		m_bench.record(frame_number, Benchmark::Frame, nowMs() - frame_start);
+		return;
+	}
 
 	VkSwapchainKHR swap_chains[] = { m_swapchain };
 
 	VkPresentInfoKHR present_info = {};
 	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	present_info.waitSemaphoreCount = 1;
-	present_info.pWaitSemaphores = signal_semaphores;
+	present_info.pWaitSemaphores = &m_render_finished_semaphores[image_idx];
 	present_info.swapchainCount = 1;
 	present_info.pSwapchains = swap_chains;
 	present_info.pImageIndices = &image_idx;
 	present_info.pResults = nullptr;
 
-	result = vkQueuePresentKHR(m_presentation_queue, &present_info);
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_framebuffer_resized) {
+	const double present_start = nowMs();
+	{
+		PROFILE_ZONE("vkQueuePresentKHR");
+		result = vkQueuePresentKHR(m_presentation_queue, &present_info);
+	}
+	m_bench.record(frame_number, Benchmark::Present, nowMs() - present_start);
+	m_bench.record(frame_number, Benchmark::Frame, nowMs() - frame_start);
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_framebuffer_resized || m_present_policy_changed) {
 		m_framebuffer_resized = false;
+		m_present_policy_changed = false;
 		rebuildSwapChain();
 	}
 	else if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to present swap chain image.");
-
-	m_current_frame = (m_current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
 void VulkanProg::createVertexBuffer()
 {
+	PROFILE_FUNCTION();
 	VkDeviceSize buffer_size = sizeof(g_vertices[0]) * g_vertices.size();
 
-	VkBuffer staging_buffer;
-	VkDeviceMemory staging_buffer_memory;
-	createBuffer(m_device, m_logical_device, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		staging_buffer, staging_buffer_memory);
+	createBuffer(m_allocator, m_logical_device, buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertex_buffer, m_vertex_buffer_alloc);
 
-	void* data;
-	vkMapMemory(m_logical_device, staging_buffer_memory, 0, buffer_size, 0, &data);
-	memcpy(data, g_vertices.data(), (size_t)buffer_size);
-	vkUnmapMemory(m_logical_device, staging_buffer_memory);
+	m_uploader.uploadBuffer(m_vertex_buffer, g_vertices.data(), buffer_size);
+}
 
-	createBuffer(m_device, m_logical_device, buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertex_buffer, m_vertex_buffer_memory);
+void VulkanProg::createIndexBuffer()
+{
+	PROFILE_FUNCTION();
+	VkDeviceSize buffer_size = sizeof(g_indices[0]) * g_indices.size();
 
-	copyBuffer(m_logical_device, m_command_pool, m_graphics_queue, staging_buffer, m_vertex_buffer, buffer_size);
+	createBuffer(m_allocator, m_logical_device, buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_index_buffer, m_index_buffer_alloc);
 
-	vkDestroyBuffer(m_logical_device, staging_buffer, nullptr);
-	vkFreeMemory(m_logical_device, staging_buffer_memory, nullptr);
+	m_uploader.uploadBuffer(m_index_buffer, g_indices.data(), buffer_size);
 }
 
-void VulkanProg::createIndexBuffer()
+bool VulkanProg::isTextureFormatUsable(VkFormat format)
 {
-	VkDeviceSize buffer_size = sizeof(g_indices[0]) * g_indices.size();
+	if (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK && !m_device_features.textureCompressionBC)
+		return false;
+	if (format >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK && format <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK && !m_device_features.textureCompressionETC2)
+		return false;
+	if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK && !m_device_features.textureCompressionASTC_LDR)
+		return false;
+
+	VkFormatProperties format_props;
+	vkGetPhysicalDeviceFormatProperties(m_device, format, &format_props);
+
+	const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (format_props.optimalTilingFeatures & required) == required;
+}
 
-	VkBuffer staging_buffer;
-	VkDeviceMemory staging_buffer_memory;
-	createBuffer(m_device, m_logical_device, buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
+bool VulkanProg::loadCompressedTexture()
+{
+	PROFILE_FUNCTION();
+	// The first variant present in the pack or on disk whose format the
+	// device can sample is used.
+	for (const char* path : COMPRESSED_TEXTURES) {
+		AssetData asset;
+		if (!m_assets.load(path, asset))
+			continue;
+
+		// A malformed file only rules out this variant, the next one or the
+		// uncompressed texture is used instead.
+		Ktx2Image ktx;
+		try {
+			parseKtx2(asset.data, asset.size, ktx);
+		}
+		catch (const std::runtime_error& e) {
+			std::cerr << path << ": " << e.what() << std::endl;
+			continue;
+		}
+		if (!isTextureFormatUsable(ktx.format))
+			continue;
 
-	void* data;
-	vkMapMemory(m_logical_device, staging_buffer_memory, 0, buffer_size, 0, &data);
-	memcpy(data, g_indices.data(), (size_t)buffer_size);
-	vkUnmapMemory(m_logical_device, staging_buffer_memory);
+		m_texture_format = ktx.format;
+		m_texture_mip_levels = static_cast<uint32_t>(ktx.levels.size());
 
-	createBuffer(m_device, m_logical_device, buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_index_buffer, m_index_buffer_memory);
+		createImage(m_allocator, m_logical_device, ktx.dims, m_texture_format, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			m_texture_image, m_texture_image_alloc, m_texture_mip_levels);
 
-	copyBuffer(m_logical_device, m_command_pool, m_graphics_queue, staging_buffer, m_index_buffer, buffer_size);
+		for (uint32_t i = 0; i < m_texture_mip_levels; i++) {
+			const Ktx2Level& level = ktx.levels[i];
+			m_uploader.uploadImageLevel(m_texture_image, asset.data + level.offset, level.size, level.dims, i);
+		}
 
-	vkDestroyBuffer(m_logical_device, staging_buffer, nullptr);
-	vkFreeMemory(m_logical_device, staging_buffer_memory, nullptr);
+		return true;
+	}
+
+	return false;
 }
 
-void VulkanProg::createTextureImage()
+void VulkanProg::decodeTexture()
 {
-	int tex_width, tex_height, tex_channels;
-	stbi_uc* pixels = stbi_load("textures/texture.jpg", &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
-	VkDeviceSize image_size = tex_width * tex_height * 4;
-
-	if (!pixels)
+	PROFILE_FUNCTION();
+	AssetData asset;
+	if (!m_assets.load("textures/texture.jpg", asset))
 		throw std::runtime_error("Failed to load texture.");
 
-	VkBuffer staging_buffer;
-	VkDeviceMemory staging_buffer_memory;
-
-	createBuffer(m_device, m_logical_device, image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_buffer_memory);
-
-	void* data;
-	vkMapMemory(m_logical_device, staging_buffer_memory, 0, image_size, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(image_size));
-	vkUnmapMemory(m_logical_device, staging_buffer_memory);
+	int tex_width, tex_height, tex_channels;
+	m_texture_pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(asset.data), static_cast<int>(asset.size),
+		&tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
 
-	stbi_image_free(pixels);
+	if (!m_texture_pixels)
+		throw std::runtime_error("Failed to load texture.");
 
-	std::array<uint32_t, 3> img_dims = {
+	m_texture_dims = {
 		static_cast<uint32_t>(tex_width),
 		static_cast<uint32_t>(tex_height),
 		1
 	};
+}
 
-	createImage(m_device, m_logical_device, img_dims, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		m_texture_image, m_texture_image_memory);
+void VulkanProg::createTextureImage()
+{
+	PROFILE_FUNCTION();
+	// The JPEG is decoded ahead of time unless a compressed variant exists,
+	// it is only decoded here if the device can't sample any of those.
+	if (!m_texture_pixels) {
+		if (loadCompressedTexture())
+			return;
+		decodeTexture();
+	}
+
+	VkDeviceSize image_size = VkDeviceSize(m_texture_dims[0]) * m_texture_dims[1] * 4;
 
-	transitionImageLayout(m_logical_device, m_command_pool, m_graphics_queue, m_texture_image, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	// The mip chain is built on the GPU with linear blits, keep a single
+	// level if the format can't be filtered that way.
+	VkFormatProperties format_props;
+	vkGetPhysicalDeviceFormatProperties(m_device, VK_FORMAT_R8G8B8A8_UNORM, &format_props);
 
-	copyBufferToImage(m_logical_device, m_command_pool, m_graphics_queue, staging_buffer, m_texture_image, img_dims);
+	const VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
 
-	transitionImageLayout(m_logical_device, m_command_pool, m_graphics_queue, m_texture_image, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	m_texture_format = VK_FORMAT_R8G8B8A8_UNORM;
+	m_texture_mip_levels = 1;
+	if ((format_props.optimalTilingFeatures & blit_features) == blit_features)
+		m_texture_mip_levels = static_cast<uint32_t>(std::floor(std::log2(std::max(m_texture_dims[0], m_texture_dims[1])))) + 1;
 
-	vkDestroyBuffer(m_logical_device, staging_buffer, nullptr);
-	vkFreeMemory(m_logical_device, staging_buffer_memory, nullptr);
+	createImage(m_allocator, m_logical_device, m_texture_dims, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_texture_image, m_texture_image_alloc, m_texture_mip_levels);
+
+	// The pixels are copied into the staging ring right away, so the decoded
+	// image can be released before the GPU copy runs.
+	m_uploader.uploadImage(m_texture_image, m_texture_pixels, image_size, m_texture_dims, m_texture_mip_levels);
+	stbi_image_free(m_texture_pixels);
+	m_texture_pixels = nullptr;
 }
 
 void VulkanProg::createTextureSampler()
 {
+	PROFILE_FUNCTION();
 	VkSamplerCreateInfo sampler_info = {};
 	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	sampler_info.minFilter = VK_FILTER_LINEAR;
@@ -1235,7 +1667,7 @@ void VulkanProg::createTextureSampler()
 	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	sampler_info.mipLodBias = 0.0f;
 	sampler_info.minLod = 0.0f;
-	sampler_info.maxLod = 0.0f;
+	sampler_info.maxLod = static_cast<float>(m_texture_mip_levels);
 
 	if (vkCreateSampler(m_logical_device, &sampler_info, nullptr, &m_texture_sampler) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create texture sampler.");
@@ -1243,9 +1675,10 @@ void VulkanProg::createTextureSampler()
 
 void VulkanProg::createDescriptorSetLayout()
 {
+	PROFILE_FUNCTION();
 	VkDescriptorSetLayoutBinding ubo_layout_binding = {};
 	ubo_layout_binding.binding = 0;
-	ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	ubo_layout_binding.descriptorCount = 1;
 	ubo_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	ubo_layout_binding.pImmutableSamplers = nullptr;
@@ -1270,30 +1703,29 @@ void VulkanProg::createDescriptorSetLayout()
 
 void VulkanProg::createUniformBuffer()
 {
-	VkDeviceSize buffer_size = sizeof(UniformBufferObject);
-
-	m_uniform_buffers.resize(m_swapchain_images.size());
-	m_uniform_buffer_memories.resize(m_swapchain_images.size());
+	PROFILE_FUNCTION();
+	VkPhysicalDeviceProperties dev_props;
+	vkGetPhysicalDeviceProperties(m_device, &dev_props);
 
-	for (size_t i = 0; i < m_swapchain_images.size(); ++i)
-		createBuffer(m_device, m_logical_device, buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			m_uniform_buffers[i], m_uniform_buffer_memories[i]);
+	// One slice per frame in flight, matching the command buffer that reads it.
+	m_uniform_ring.init(m_allocator, m_logical_device, dev_props.limits.minUniformBufferOffsetAlignment,
+		sizeof(UniformBufferObject), m_options.object_count, m_options.max_frames_in_flight);
 }
 
 void VulkanProg::createDescriptorPool()
 {
+	PROFILE_FUNCTION();
 	std::array<VkDescriptorPoolSize, 2> pool_sizes = {};
-	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	pool_sizes[0].descriptorCount = static_cast<uint32_t>(m_swapchain_images.size());
+	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	pool_sizes[0].descriptorCount = 1;
 	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	pool_sizes[1].descriptorCount = static_cast<uint32_t>(m_swapchain_images.size());
+	pool_sizes[1].descriptorCount = 1;
 
 	VkDescriptorPoolCreateInfo pool_info = {};
 	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
 	pool_info.pPoolSizes = pool_sizes.data();
-	pool_info.maxSets = static_cast<uint32_t>(m_swapchain_images.size());
+	pool_info.maxSets = 1;
 
 	if (vkCreateDescriptorPool(m_logical_device, &pool_info, nullptr, &m_descriptor_pool) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create descriptor pool.");
@@ -1301,68 +1733,80 @@ void VulkanProg::createDescriptorPool()
 
 void VulkanProg::createDescriptorSets()
 {
-	std::vector<VkDescriptorSetLayout> layouts(m_swapchain_images.size(), m_descriptor_set_layout);
+	PROFILE_FUNCTION();
 	VkDescriptorSetAllocateInfo alloc_info = {};
 	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	alloc_info.descriptorPool = m_descriptor_pool;
-	alloc_info.descriptorSetCount = static_cast<uint32_t>(m_swapchain_images.size());
-	alloc_info.pSetLayouts = layouts.data();
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &m_descriptor_set_layout;
 
-	m_descriptor_sets.resize(m_swapchain_images.size());
-	if (vkAllocateDescriptorSets(m_logical_device, &alloc_info, m_descriptor_sets.data()) != VK_SUCCESS)
+	if (vkAllocateDescriptorSets(m_logical_device, &alloc_info, &m_descriptor_set) != VK_SUCCESS)
 		throw std::runtime_error("Failed to allocate descriptor sets.");
 
-	for (size_t i = 0; i < m_swapchain_images.size(); ++i) {
-		VkDescriptorBufferInfo buffer_info = {};
-		buffer_info.buffer = m_uniform_buffers[i];
-		buffer_info.offset = 0;
-		buffer_info.range = sizeof(UniformBufferObject);
-
-		VkDescriptorImageInfo image_info = {};
-		image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		image_info.imageView = m_texture_image_view;
-		image_info.sampler = m_texture_sampler;
-
-		std::array<VkWriteDescriptorSet, 2> desc_write = {};
-		desc_write[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		desc_write[0].dstSet = m_descriptor_sets[i];
-		desc_write[0].dstBinding = 0;
-		desc_write[0].dstArrayElement = 0;
-		desc_write[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		desc_write[0].descriptorCount = 1;
-		desc_write[0].pBufferInfo = &buffer_info;
-		desc_write[0].pImageInfo = nullptr;
-		desc_write[0].pTexelBufferView = nullptr;
-
-		desc_write[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		desc_write[1].dstSet = m_descriptor_sets[i];
-		desc_write[1].dstBinding = 1;
-		desc_write[1].dstArrayElement = 0;
-		desc_write[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		desc_write[1].descriptorCount = 1;
-		desc_write[1].pImageInfo = &image_info;
-
-		vkUpdateDescriptorSets(m_logical_device, static_cast<uint32_t>(desc_write.size()), desc_write.data(), 0, nullptr);
-	}
+	// The dynamic offset picks the object's uniforms inside the ring, so a
+	// single set covers every object and frame.
+	VkDescriptorBufferInfo buffer_info = {};
+	buffer_info.buffer = m_uniform_ring.buffer();
+	buffer_info.offset = 0;
+	buffer_info.range = sizeof(UniformBufferObject);
+
+	VkDescriptorImageInfo image_info = {};
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_info.imageView = m_texture_image_view;
+	image_info.sampler = m_texture_sampler;
+
+	std::array<VkWriteDescriptorSet, 2> desc_write = {};
+	desc_write[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	desc_write[0].dstSet = m_descriptor_set;
+	desc_write[0].dstBinding = 0;
+	desc_write[0].dstArrayElement = 0;
+	desc_write[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	desc_write[0].descriptorCount = 1;
+	desc_write[0].pBufferInfo = &buffer_info;
+	desc_write[0].pImageInfo = nullptr;
+	desc_write[0].pTexelBufferView = nullptr;
+
+	desc_write[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	desc_write[1].dstSet = m_descriptor_set;
+	desc_write[1].dstBinding = 1;
+	desc_write[1].dstArrayElement = 0;
+	desc_write[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	desc_write[1].descriptorCount = 1;
+	desc_write[1].pImageInfo = &image_info;
+
+	vkUpdateDescriptorSets(m_logical_device, static_cast<uint32_t>(desc_write.size()), desc_write.data(), 0, nullptr);
 }
 
-void VulkanProg::updateUniformBuffer(uint32_t image_index)
+void VulkanProg::updateUniformBuffer(uint32_t frame, JobSystem::Counter& counter)
 {
+	PROFILE_FUNCTION();
 	static auto start_time = std::chrono::high_resolution_clock::now();
 
-	auto curr_time = std::chrono::high_resolution_clock::now();
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(curr_time - start_time).count();
-
-	UniformBufferObject ubo = {};
-	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.view = glm::lookAt(glm::vec3(2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.proj = glm::perspective(glm::radians(45.0f), m_swapchain_extent.width / (float)m_swapchain_extent.height, 0.1f, 10.0f);
-	ubo.proj[1][1] *= -1;
+	// Benchmark runs animate on a simulated clock, frame N always shows the
+	// same scene however long the frames before it took.
+	float time = (m_frame_number + 1) * BENCH_FRAME_TIME;
+	if (!m_bench.active()) {
+		auto curr_time = std::chrono::high_resolution_clock::now();
+		time = std::chrono::duration<float, std::chrono::seconds::period>(curr_time - start_time).count();
+	}
 
-	void* data;
-	vkMapMemory(m_logical_device, m_uniform_buffer_memories[image_index], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(m_logical_device, m_uniform_buffer_memories[image_index]);
+	glm::mat4 view = glm::lookAt(glm::vec3(2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), m_swapchain_extent.width / (float)m_swapchain_extent.height, 0.1f, 10.0f);
+	proj[1][1] *= -1;
+
+	// Writes go straight into the persistently mapped ring, no map/unmap.
+	// Every object owns a fixed element, so the ranges fill in parallel.
+	const uint32_t object_count = m_options.object_count;
+	m_jobs.parallelFor(object_count, UNIFORM_JOB_GRAIN, [this, frame, object_count, time, view, proj](uint32_t first, uint32_t count) {
+		PROFILE_ZONE("uniform job");
+		for (uint32_t obj = first; obj < first + count; ++obj) {
+			UniformBufferObject ubo = {};
+			ubo.model = objectModel(obj, object_count, time);
+			ubo.view = view;
+			ubo.proj = proj;
+			m_uniform_ring.write(frame, obj, &ubo, sizeof(ubo));
+		}
+	}, counter);
 }
 
 void VulkanProg::cleanupSwapChain()
@@ -1370,45 +1814,105 @@ void VulkanProg::cleanupSwapChain()
 	for (auto fb : m_swapchain_framebuffers)
 		vkDestroyFramebuffer(m_logical_device, fb, nullptr);
 
-	vkFreeCommandBuffers(m_logical_device, m_command_pool, static_cast<uint32_t>(m_command_buffers.size()), m_command_buffers.data());
-
-	vkDestroyPipeline(m_logical_device, m_graphics_pipeline, nullptr);
-	vkDestroyPipelineLayout(m_logical_device, m_pipeline_layout, nullptr);
-	vkDestroyRenderPass(m_logical_device, m_renderpass, nullptr);
-
 	for (auto iv : m_swapchain_image_views)
 		vkDestroyImageView(m_logical_device, iv, nullptr);
 
+	for (auto semaphore : m_render_finished_semaphores)
+		vkDestroySemaphore(m_logical_device, semaphore, nullptr);
+
+	if (m_options.headless) {
+		for (size_t i = 0; i < m_swapchain_images.size(); ++i) {
+			vkDestroyImage(m_logical_device, m_swapchain_images[i], nullptr);
+			m_allocator.free(m_offscreen_allocs[i]);
+		}
+		return;
+	}
+
 	vkDestroySwapchainKHR(m_logical_device, m_swapchain, nullptr);
 }
 
+void VulkanProg::retireSwapChain()
+{
+	VkDevice device = m_logical_device;
+	VkSwapchainKHR swapchain = m_swapchain;
+	std::vector<VkImageView> image_views;
+	std::vector<VkFramebuffer> framebuffers;
+	std::vector<VkSemaphore> semaphores;
+	image_views.swap(m_swapchain_image_views);
+	framebuffers.swap(m_swapchain_framebuffers);
+	semaphores.swap(m_render_finished_semaphores);
+
+	// m_swapchain stays set so the new swapchain can name it as oldSwapchain.
+	m_deletion_queue.push(swapChainRetireFrame(), [=]() {
+		for (auto fb : framebuffers)
+			vkDestroyFramebuffer(device, fb, nullptr);
+
+		for (auto iv : image_views)
+			vkDestroyImageView(device, iv, nullptr);
+
+		for (auto semaphore : semaphores)
+			vkDestroySemaphore(device, semaphore, nullptr);
+
+		vkDestroySwapchainKHR(device, swapchain, nullptr);
+	});
+}
+
+uint64_t VulkanProg::swapChainRetireFrame() const
+{
+	// The frame timeline only covers rendering. The presents that wait on
+	// the old render_finished semaphores may still be pending in the present
+	// engine, and the old swapchain must not be destroyed before they are
+	// done. Without a present fence the closest bound is a full round of
+	// frames in flight, all acquired and presented on the new swapchain,
+	// having completed after the last frame that presented on the old one.
+	return m_frame_number + m_options.max_frames_in_flight + 1;
+}
+
 void VulkanProg::rebuildSwapChain()
 {
+	PROFILE_FUNCTION();
 	int width = 0;
 	int height = 0;
 	while (!width || !height) {
 		glfwGetFramebufferSize(m_window, &width, &height);
 		glfwWaitEvents();
 	}
+	m_framebuffer_extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 
-	vkDeviceWaitIdle(m_logical_device);
+	retireSwapChain();
 
-	cleanupSwapChain();
+	VkFormat old_format = m_swapchain_format;
 
 	createSwapChain();
 	createImageViews();
-	createRenderPass();
-	createGraphicsPipeline();
+
+	// The render pass only depends on the surface format, and with dynamic
+	// viewport and scissor the pipeline only depends on the render pass.
+	if (m_swapchain_format != old_format) {
+		VkDevice device = m_logical_device;
+		VkPipeline pipeline = m_graphics_pipeline;
+		VkPipelineLayout pipeline_layout = m_pipeline_layout;
+		VkRenderPass renderpass = m_renderpass;
+
+		m_deletion_queue.push(swapChainRetireFrame(), [=]() {
+			vkDestroyPipeline(device, pipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+			vkDestroyRenderPass(device, renderpass, nullptr);
+		});
+
+		createRenderPass();
+		createGraphicsPipeline();
+	}
+
 	createFramebuffers();
-	createCommandBuffers();
 }
 
-VkShaderModule VulkanProg::createShaderModule(const std::vector<char>& bytecode)
+VkShaderModule VulkanProg::createShaderModule(const char* bytecode, size_t size)
 {
 	VkShaderModuleCreateInfo create_info = {};
 	create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	create_info.codeSize = static_cast<uint32_t>(bytecode.size());
-	create_info.pCode = reinterpret_cast<const uint32_t*>(bytecode.data());
+	create_info.codeSize = size;
+	create_info.pCode = reinterpret_cast<const uint32_t*>(bytecode);
 
 	VkShaderModule shader;
 	if (vkCreateShaderModule(m_logical_device, &create_info, nullptr, &shader) != VK_SUCCESS)
@@ -1419,22 +1923,35 @@ VkShaderModule VulkanProg::createShaderModule(const std::vector<char>& bytecode)
 
 bool VulkanProg::isDeviceSuitable(VkPhysicalDevice device)
 {
-	//VkPhysicalDeviceProperties dev_properties;
-	//vkGetPhysicalDeviceProperties(device, &dev_properties);
+	VkPhysicalDeviceProperties dev_properties;
+	vkGetPhysicalDeviceProperties(device, &dev_properties);
+
+	// Frame pacing and uploads are built on timeline semaphores.
+	if (dev_properties.apiVersion < VK_API_VERSION_1_2)
+		return false;
+
+	VkPhysicalDeviceVulkan12Features vk12_features = {};
+	vk12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+
+	VkPhysicalDeviceFeatures2 features2 = {};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &vk12_features;
+	vkGetPhysicalDeviceFeatures2(device, &features2);
 
-	VkPhysicalDeviceFeatures dev_features;
-	vkGetPhysicalDeviceFeatures(device, &dev_features);
+	const VkPhysicalDeviceFeatures& dev_features = features2.features;
 
 	QueueFamilyIndices indices = findQueueFamilies(device);
-	bool extensions_supported = checkDeviceExtensionSupport(device);
+	bool extensions_supported = checkDeviceExtensionSupport(device, requiredDeviceExtensions());
 
-	bool swap_chain_adequate = false;
-	if (extensions_supported) {
+	// Headless rendering goes to our own images, there is no swapchain.
+	bool swap_chain_adequate = m_options.headless;
+	if (extensions_supported && !m_options.headless) {
 		SwapChainSupportDetails swap_chain_support = querySwapChainSupport(device);
 		swap_chain_adequate = !swap_chain_support.surface_formats.empty() && !swap_chain_support.present_modes.empty();
 	}
 
-	return indices.isComplete() && extensions_supported && swap_chain_adequate && dev_features.samplerAnisotropy;
+	return indices.isComplete() && extensions_supported && swap_chain_adequate && dev_features.samplerAnisotropy
+		&& vk12_features.timelineSemaphore;
 }
 
 QueueFamilyIndices VulkanProg::findQueueFamilies(VkPhysicalDevice device)
@@ -1452,8 +1969,12 @@ QueueFamilyIndices VulkanProg::findQueueFamilies(VkPhysicalDevice device)
 		if (family.queueCount > 0 && family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
 			indices.graphics_family = i;
 
+		// Without a surface nothing is presented, the graphics queue stands in.
 		VkBool32 support_presentation = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &support_presentation);
+		if (m_surface != VK_NULL_HANDLE)
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &support_presentation);
+		else
+			support_presentation = (family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
 
 		if (family.queueCount > 0 && support_presentation)
 			indices.present_family = i;
@@ -1464,6 +1985,21 @@ QueueFamilyIndices VulkanProg::findQueueFamilies(VkPhysicalDevice device)
 		i++;
 	}
 
+	// Prefer a pure copy engine, then any family that can transfer but not draw.
+	for (uint32_t j = 0; j < count; j++) {
+		VkQueueFlags flags = families[j].queueFlags;
+		if (families[j].queueCount == 0 || !(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+			continue;
+
+		if (!(flags & VK_QUEUE_COMPUTE_BIT)) {
+			indices.transfer_family = j;
+			break;
+		}
+
+		if (!indices.transfer_family.has_value())
+			indices.transfer_family = j;
+	}
+
 	return indices;
 }
 
@@ -1502,16 +2038,44 @@ VkSurfaceFormatKHR VulkanProg::chooseSwapSurfaceFormat(const std::vector<VkSurfa
 
 VkPresentModeKHR VulkanProg::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& available_present_modes)
 {
-	VkPresentModeKHR best_mode = VK_PRESENT_MODE_FIFO_KHR;
+	// Preferred modes per policy, best first. FIFO is always supported and
+	// ends every list.
+	std::vector<VkPresentModeKHR> preferred;
+	switch (m_options.present_policy) {
+	case PresentPolicy::LowestLatency:
+		preferred = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+		break;
+	// Both are plain FIFO, LowPower also pins the frames in flight to one.
+	// FIFO_RELAXED would tear on late frames, which VSync promises not to do.
+	case PresentPolicy::VSync:
+	case PresentPolicy::LowPower:
+		break;
+	case PresentPolicy::TearFreeLowLatency:
+		preferred = { VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	}
 
-	for (const auto& available_present_mode : available_present_modes) {
-		if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR)
-			return available_present_mode;
-		else if (available_present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR)
-			best_mode = available_present_mode;
+	for (auto mode : preferred) {
+		if (std::find(available_present_modes.begin(), available_present_modes.end(), mode) != available_present_modes.end())
+			return mode;
 	}
 
-	return best_mode;
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void VulkanProg::setPresentPolicy(PresentPolicy policy)
+{
+	if (policy == m_options.present_policy)
+		return;
+
+	// Applied by the next frame. Only the swapchain is recreated, the render
+	// pass and pipeline survive as long as the surface format does.
+	m_options.present_policy = policy;
+	m_present_policy_changed = true;
+
+	// Low power also keeps a single frame in flight, so the CPU and GPU
+	// take turns and both idle for the rest of the refresh.
+	m_pacer.pin(policy == PresentPolicy::LowPower ? 1 : 0);
 }
 
 VkExtent2D VulkanProg::chooseSwapExtent(const VkSurfaceCapabilitiesKHR & capabilities)
@@ -1519,9 +2083,7 @@ VkExtent2D VulkanProg::chooseSwapExtent(const VkSurfaceCapabilitiesKHR & capabil
 	if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
 		return capabilities.currentExtent;
 	else {
-		int width, height;
-		glfwGetFramebufferSize(m_window, &width, &height);
-		VkExtent2D actual_extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+		VkExtent2D actual_extent = m_framebuffer_extent;
 		actual_extent.width = std::clamp(actual_extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
 		actual_extent.height = std::clamp(actual_extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
 		return actual_extent;
@@ -3,6 +3,19 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include "allocator.h"
+#include "assetpack.h"
+#include "bench.h"
+#include "cpuprofiler.h"
+#include "deletionqueue.h"
+#include "framepacer.h"
+#include "gpuprofiler.h"
+#include "jobs.h"
+#include "options.h"
+#include "recorder.h"
+#include "ringbuffer.h"
+#include "uploader.h"
+
 
 struct GLFWwindow;
 struct QueueFamilyIndices;
@@ -15,7 +28,8 @@ class VulkanProg
 public:
     void run()
     {
-        initWindow();
+        if (!m_options.headless)
+            initWindow();
         initVulkan();
         mainLoop();
         cleanup();
@@ -26,40 +40,63 @@ public:
         m_framebuffer_resized = resized;
     }
 
+    void setOptions(const RenderOptions& options)
+    {
+        m_options = options;
+    }
+
+    void setPresentPolicy(PresentPolicy policy);
+
 private:
     void initVulkan();
+    void createInstance();
+    void loadShaders();
     void initWindow();
     void mainLoop();
     void cleanup();
 
     bool checkValidationlayerSupport();
     std::vector<const char*> getRequiredExtensions();
+    std::vector<const char*> requiredDeviceExtensions();
     void setupDebugCb();
     void pickPhysicalDevice();
     void createLogicalDevice();
+    void createPipelineCache();
+    void savePipelineCache();
     void createSwapChain();
+    void createOffscreenTargets();
     void createImageViews();
     void createRenderPass();
     void createGraphicsPipeline();
     void createFramebuffers();
     void createCommandPool();
     void createCommandBuffers();
+    void recordCommandBuffer(VkCommandBuffer cmd_buffer, uint32_t image_index);
+    void recordDraws(VkCommandBuffer cmd_buffer, uint32_t frame, uint32_t first, uint32_t count);
     void createSyncObjects();
+    void collectGpuTimes();
     void drawFrame();
+    uint64_t completedFrame();
+    void waitForFrame(uint64_t frame_number);
     void createVertexBuffer();
     void createIndexBuffer();
+    bool isTextureFormatUsable(VkFormat format);
+    bool loadCompressedTexture();
+    void decodeTexture();
     void createTextureImage();
     void createTextureSampler();
     void createDescriptorSetLayout();
     void createUniformBuffer();
     void createDescriptorPool();
     void createDescriptorSets();
-    void updateUniformBuffer(uint32_t image_index);
+    void updateUniformBuffer(uint32_t frame, JobSystem::Counter& counter);
 
     void cleanupSwapChain();
     void rebuildSwapChain();
+    void retireSwapChain();
+    uint64_t swapChainRetireFrame() const;
 
-    VkShaderModule createShaderModule(const std::vector<char>& bytecode);
+    VkShaderModule createShaderModule(const char* bytecode, size_t size);
     bool isDeviceSuitable(VkPhysicalDevice device);
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
@@ -68,46 +105,83 @@ private:
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
 private:
-    GLFWwindow* m_window;
+    GLFWwindow* m_window = nullptr;
     VkInstance m_instance;
     VkDebugUtilsMessengerEXT m_debug_messenger;
     VkPhysicalDevice m_device = VK_NULL_HANDLE;
     VkDevice m_logical_device;
+    VkPhysicalDeviceFeatures m_device_features = {};
     VkQueue m_graphics_queue;
+    uint32_t m_graphics_family = 0;
     VkQueue m_presentation_queue;
-    VkSurfaceKHR m_surface;
-    VkSwapchainKHR m_swapchain;
+    VkQueue m_transfer_queue;
+    DeviceAllocator m_allocator;
+    AssetPack m_assets;
+    Uploader m_uploader;
+    uint64_t m_upload_ticket = 0;
+    VkSurfaceKHR m_surface = VK_NULL_HANDLE;
+    VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
     VkFormat m_swapchain_format;
     VkExtent2D m_swapchain_extent;
     std::vector<VkImage> m_swapchain_images;
+    // Number of the frame that last rendered to each swapchain image.
+    std::vector<uint64_t> m_images_in_flight;
+    // Backing memory of the images standing in for the swapchain when headless.
+    std::vector<Allocation> m_offscreen_allocs;
     std::vector<VkImageView> m_swapchain_image_views;
     VkRenderPass m_renderpass;
     VkDescriptorSetLayout m_descriptor_set_layout;
     VkPipelineLayout m_pipeline_layout;
     VkPipeline m_graphics_pipeline;
+    VkPipelineCache m_pipeline_cache = VK_NULL_HANDLE;
     std::vector<VkFramebuffer> m_swapchain_framebuffers;
-    VkCommandPool m_command_pool;
+    std::vector<VkCommandPool> m_command_pools;
     std::vector<VkCommandBuffer> m_command_buffers;
+    CommandRecorder m_recorder;
     std::vector<VkSemaphore> m_image_available_semaphores;
     std::vector<VkSemaphore> m_render_finished_semaphores;
-    std::vector<VkFence> m_inflight_fences;
+    VkSemaphore m_frame_timeline = VK_NULL_HANDLE;
+    // Number of the last frame submitted, frames count from 1.
+    uint64_t m_frame_number = 0;
+    // Slot of the frame being recorded, in [0, max_frames_in_flight).
     size_t m_current_frame = 0;
+    FramePacer m_pacer;
+    double m_last_frame_start = 0.0;
+    Benchmark m_bench;
+    GpuProfiler m_gpu_profiler;
+    GpuProfiler::RegionId m_frame_region = 0;
+    DeletionQueue m_deletion_queue;
     VkBuffer m_vertex_buffer;
-    VkDeviceMemory m_vertex_buffer_memory;
+    Allocation m_vertex_buffer_alloc;
     VkBuffer m_index_buffer;
-    VkDeviceMemory m_index_buffer_memory;
-    std::vector<VkBuffer> m_uniform_buffers;
-    std::vector<VkDeviceMemory> m_uniform_buffer_memories;
+    Allocation m_index_buffer_alloc;
+    UniformRing m_uniform_ring;
     VkDescriptorPool m_descriptor_pool;
-    std::vector<VkDescriptorSet> m_descriptor_sets;
+    VkDescriptorSet m_descriptor_set;
     VkImage m_texture_image;
-    VkDeviceMemory m_texture_image_memory;
+    VkFormat m_texture_format = VK_FORMAT_R8G8B8A8_UNORM;
+    uint32_t m_texture_mip_levels = 1;
+    Allocation m_texture_image_alloc;
+    // Decoded while the device is created, released once staged.
+    unsigned char* m_texture_pixels = nullptr;
+    std::array<uint32_t, 3> m_texture_dims = {};
+    AssetData m_vert_code;
+    AssetData m_frag_code;
     VkImageView m_texture_image_view;
     VkSampler m_texture_sampler;
 
     const int WIDTH = 800;
     const int HEIGHT = 600;
     bool m_framebuffer_resized = false;
+    // Read on the main thread, see initWindow().
+    VkExtent2D m_framebuffer_extent = {};
+    double m_init_start_ms = 0.0;
+    bool m_present_policy_changed = false;
+    VkPresentModeKHR m_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+    RenderOptions m_options;
+    // Last, so it is destroyed first: its workers are joined before any of
+    // the members their jobs touch go away.
+    JobSystem m_jobs;
 };
 
 
@@ -121,7 +195,22 @@ const std::vector<const char*> device_extensions = {
 };
 
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// Step of the simulated clock in benchmark runs, in seconds.
+const float BENCH_FRAME_TIME = 1.0f / 60.0f;
+
+
+// Objects per uniform update job.
+const uint32_t UNIFORM_JOB_GRAIN = 512;
+
+
+// Timestamp pairs the GPU profiler can have waiting to be read.
+const uint32_t GPU_PROFILER_SCOPES = 256;
+
+
+const VkDeviceSize STAGING_BUFFER_SIZE = 32 * 1024 * 1024;
+
+
+const char* const PIPELINE_CACHE_PATH = "pipeline_cache.bin";
 
 
 #endif // __VULKAN_PROG__